@@ -51,6 +51,14 @@ IF(CMAKE_SYSTEM_NAME MATCHES "Linux")
       set(SSE4_2_FOUND false CACHE BOOL "SSE4.2 available on host")
    ENDIF (SSE42_TRUE)
 
+   STRING(REGEX REPLACE "^.*(avx2).*$" "\\1" AVX_THERE ${CPUINFO})
+   STRING(COMPARE EQUAL "avx2" "${AVX_THERE}" AVX2_TRUE)
+   IF (AVX2_TRUE)
+      set(AVX2_FOUND true CACHE BOOL "AVX2 available on host")
+   ELSE (AVX2_TRUE)
+      set(AVX2_FOUND false CACHE BOOL "AVX2 available on host")
+   ENDIF (AVX2_TRUE)
+
 ELSEIF(CMAKE_SYSTEM_NAME MATCHES "Darwin")
    EXEC_PROGRAM("/usr/sbin/sysctl -n machdep.cpu.features" OUTPUT_VARIABLE
       CPUINFO)
@@ -95,6 +103,14 @@ ELSEIF(CMAKE_SYSTEM_NAME MATCHES "Darwin")
       set(SSE4_2_FOUND false CACHE BOOL "SSE4.2 available on host")
    ENDIF (SSE42_TRUE)
 
+   STRING(REGEX REPLACE "^.*(AVX2).*$" "\\1" AVX_THERE ${CPUINFO})
+   STRING(COMPARE EQUAL "AVX2" "${AVX_THERE}" AVX2_TRUE)
+   IF (AVX2_TRUE)
+      set(AVX2_FOUND true CACHE BOOL "AVX2 available on host")
+   ELSE (AVX2_TRUE)
+      set(AVX2_FOUND false CACHE BOOL "AVX2 available on host")
+   ENDIF (AVX2_TRUE)
+
 ELSEIF(CMAKE_SYSTEM_NAME MATCHES "Windows")
    # TODO
    set(SSE2_FOUND   true  CACHE BOOL "SSE2 available on host")
@@ -102,12 +118,14 @@ ELSEIF(CMAKE_SYSTEM_NAME MATCHES "Windows")
    set(SSSE3_FOUND  false CACHE BOOL "SSSE3 available on host")
    set(SSE4_1_FOUND false CACHE BOOL "SSE4.1 available on host")
    set(SSE4_2_FOUND false CACHE BOOL "SSE4.2 available on host")
+   set(AVX2_FOUND   false CACHE BOOL "AVX2 available on host")
 ELSE(CMAKE_SYSTEM_NAME MATCHES "Linux")
    set(SSE2_FOUND   true  CACHE BOOL "SSE2 available on host")
    set(SSE3_FOUND   false CACHE BOOL "SSE3 available on host")
    set(SSSE3_FOUND  false CACHE BOOL "SSSE3 available on host")
    set(SSE4_1_FOUND false CACHE BOOL "SSE4.1 available on host")
    set(SSE4_2_FOUND false CACHE BOOL "SSE4.2 available on host")
+   set(AVX2_FOUND   false CACHE BOOL "AVX2 available on host")
 ENDIF(CMAKE_SYSTEM_NAME MATCHES "Linux")
 
 IF(CMAKE_COMPILER_IS_GNUCXX)
@@ -133,7 +151,10 @@ endif(NOT SSE4_1_FOUND)
 if(NOT SSE4_2_FOUND)
       MESSAGE(STATUS "Could not find support for SSE4.2 on this machine.")
 endif(NOT SSE4_2_FOUND)
+if(NOT AVX2_FOUND)
+      MESSAGE(STATUS "Could not find support for AVX2 on this machine.")
+endif(NOT AVX2_FOUND)
 
-mark_as_advanced(SSE2_FOUND SSE3_FOUND SSSE3_FOUND SSE4_1_FOUND SSE4_2_FOUND)
+mark_as_advanced(SSE2_FOUND SSE3_FOUND SSSE3_FOUND SSE4_1_FOUND SSE4_2_FOUND AVX2_FOUND)
 
 ENDMACRO(FindSSE)
@@ -2,6 +2,7 @@
 
 #include "sdsl/int_vector.hpp"
 #include "bit_streams.hpp"
+#include "simd_bit_packing.hpp"
 #include "zlib.h"
 #include "lz4hc.h"
 #include "lz4.h"
@@ -13,7 +14,12 @@
 
 #include "logging.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
 namespace coder {
 
 struct vbyte {
@@ -34,22 +40,25 @@ struct vbyte {
     {
         static_assert(std::numeric_limits<T>::is_signed == false, "can only encode unsigned integers");
         os.expand_if_needed(encoded_length(y));
-        uint64_t x = y;
-        uint8_t w = x & 0x7F;
-        x >>= 7;
-        while (x > 0) {
-            w |= 0x80; // mark overflow bit
-            os.put_int_no_size_check(w, 8);
-            w = x & 0x7F;
-            x >>= 7;
-        }
-        os.put_int_no_size_check(w, 8);
+        encode(os, y);
     }
     template <class t_bit_ostream, typename T>
     inline void encode(t_bit_ostream& os, T y) const
     {
         static_assert(std::numeric_limits<T>::is_signed == false, "can only encode unsigned integers");
         uint64_t x = y;
+        if (x < (1ULL << 56)) { // all bytes fit into one word and are written at once
+            uint64_t w = 0;
+            uint8_t len = 0;
+            while (x >= 128) {
+                w |= ((x & 0x7F) | 0x80) << len; // mark overflow bit
+                len += 8;
+                x >>= 7;
+            }
+            w |= x << len;
+            os.put_int_no_size_check(w, len + 8);
+            return;
+        }
         uint8_t w = x & 0x7F;
         x >>= 7;
         while (x > 0) {
@@ -89,12 +98,50 @@ struct vbyte {
         } while ((w & 0x80) > 0);
         return ww;
     }
+    /*
+        reads the next 8 bytes as one word (at any bit position) and decodes
+        all integers which end in it, the terminating bytes are found with
+        one mask over the word. at least one byte per remaining integer
+        belongs to the stream, so the word is only read while 8 or more
+        integers are left. the rest is decoded one byte at a time.
+
+        there is no separate SIMD masked vbyte (pshufb) coder: its shuffle
+        tables need byte aligned input, but a vbyte stream here can start at
+        any bit after a fixed width stream. the word mask above is the masked
+        decoder that works at any bit position.
+     */
     template <class t_bit_istream, class T>
     inline void decode(const t_bit_istream& is, T* out_buf, size_t n) const
     {
-        for (size_t i = 0; i < n; i++) {
-            *out_buf = decode(is);
-            ++out_buf;
+        size_t i = 0;
+        while (i + 8 <= n) {
+            uint64_t w = is.peek_int(64);
+            uint64_t stops = ~w & 0x8080808080808080ULL;
+            if (stops == 0) { // integer of more than 8 bytes
+                out_buf[i++] = decode(is);
+                continue;
+            }
+            if (stops == 0x8080808080808080ULL) { // 8 one byte integers
+                for (size_t k = 0; k < 8; k++)
+                    out_buf[i + k] = (w >> (8 * k)) & 0x7F;
+                i += 8;
+                is.skip(64);
+                continue;
+            }
+            uint64_t consumed = 0;
+            do {
+                uint64_t end = __builtin_ctzll(stops) + 1; // bits up to the end of the terminating byte
+                uint64_t x = 0;
+                for (uint64_t b = consumed, shift = 0; b < end; b += 8, shift += 7)
+                    x |= ((w >> b) & 0x7F) << shift;
+                out_buf[i++] = x;
+                consumed = end;
+                stops &= stops - 1;
+            } while (stops);
+            is.skip(consumed);
+        }
+        for (; i < n; i++) {
+            out_buf[i] = decode(is);
         }
     }
 };
@@ -114,10 +161,36 @@ public:
         for (size_t i = 0; i < n; i++)
             os.put_int_no_size_check(in_buf[i], t_width);
     }
+    /*
+        value i is read with one unaligned 8 byte load at the byte of its first
+        bit, a shift and a mask (assumes a little endian machine). the values
+        do not depend on each other, so the loop has no carried state but the
+        bit position. loads are only done while they stay within the bits of
+        the n values, the last few values and widths above 57 bits (which
+        may not fit into one load) use get_int.
+     */
     template <class t_bit_istream, class T>
     inline void decode(const t_bit_istream& is, T* out_buf, size_t n) const
     {
-        for (size_t i = 0; i < n; i++)
+        size_t i = 0;
+        if (t_width > 0 && t_width <= 57) {
+            const uint8_t* data = (const uint8_t*)is.data();
+            const uint64_t mask = t_width >= 64 ? ~0ULL : (1ULL << (t_width & 63)) - 1;
+            const uint64_t start = is.tellg();
+            const uint64_t end_byte = (start + t_width * n + 7) / 8;
+            size_t n_fast = 0;
+            if (end_byte >= 8 + start / 8)
+                n_fast = std::min(n, (size_t)(((end_byte - 8) * 8 + 7 - start) / t_width + 1));
+            uint64_t pos = start;
+            for (; i < n_fast; i++) {
+                uint64_t w;
+                std::memcpy(&w, data + (pos >> 3), 8);
+                out_buf[i] = (w >> (pos & 7)) & mask;
+                pos += t_width;
+            }
+            is.seek(pos);
+        }
+        for (; i < n; i++)
             out_buf[i] = is.get_int(t_width);
     }
 };
@@ -151,6 +224,472 @@ public:
     }
 };
 
+/*
+    SIMD-BP128: blocks of 128 values are bit packed with the width of their
+    largest value (see simd_bit_packing.hpp), the last n % 128 values are
+    vbyte coded. the output is byte aligned.
+ */
+struct simd_bp128 {
+    static std::string type()
+    {
+        return "simdbp128";
+    }
+
+    template <class t_bit_ostream, class T>
+    inline void encode(t_bit_ostream& os, const T* in_buf, size_t n) const
+    {
+        using namespace simd_bit_packing;
+        static_assert(sizeof(T) == sizeof(uint32_t), "simd_bp128 encodes 32-bit integers");
+        const uint32_t* in = (const uint32_t*)in_buf;
+        os.expand_if_needed(8 + 8 * ((n / block_len) * (1 + 16 * 32) + 5 * (n % block_len)));
+        os.align8();
+        uint8_t* start = os.cur_data8();
+        uint8_t* out = start;
+        size_t i = 0;
+        for (; i + block_len <= n; i += block_len) {
+            auto b = max_bits(in + i);
+            *out++ = b;
+            pack(in + i, out, b);
+            out += 16 * b;
+        }
+        for (; i < n; i++)
+            put_vbyte(out, in[i]);
+        os.skip(8 * (out - start));
+    }
+    template <class t_bit_istream, class T>
+    inline void decode(const t_bit_istream& is, T* out_buf, size_t n) const
+    {
+        using namespace simd_bit_packing;
+        static_assert(sizeof(T) == sizeof(uint32_t), "simd_bp128 decodes 32-bit integers");
+        uint32_t* out = (uint32_t*)out_buf;
+        is.align8();
+        const uint8_t* start = is.cur_data8();
+        const uint8_t* in = start;
+        size_t i = 0;
+        for (; i + block_len <= n; i += block_len) {
+            auto b = *in++;
+            unpack(in, out + i, b);
+            in += 16 * b;
+        }
+        for (; i < n; i++)
+            out[i] = get_vbyte(in);
+        is.skip(8 * (in - start));
+    }
+};
+
+/*
+    patched frame of reference on top of the SIMD-BP128 packing: each block
+    of 128 values is packed with the width b that minimizes its size, values
+    of more than b bits are exceptions whose position (one byte) and high
+    bits (vbyte) follow the packed block and are patched in after unpacking.
+    the last n % 128 values are vbyte coded. the output is byte aligned.
+ */
+struct simd_pfor {
+    static std::string type()
+    {
+        return "simdpfor";
+    }
+
+    /* the width with the smallest encoding of the block */
+    static uint32_t best_width(const uint32_t* in)
+    {
+        using namespace simd_bit_packing;
+        uint32_t count[33] = { 0 };
+        for (size_t i = 0; i < block_len; i++)
+            count[bits(in[i])]++;
+        uint32_t best_b = 32;
+        uint32_t best_cost = 16 * 32;
+        for (uint32_t b = 0; b < 32; b++) {
+            uint32_t cost = 16 * b;
+            for (uint32_t w = b + 1; w <= 32; w++)
+                cost += count[w] * (1 + (w - b + 6) / 7);
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_b = b;
+            }
+        }
+        return best_b;
+    }
+
+    template <class t_bit_ostream, class T>
+    inline void encode(t_bit_ostream& os, const T* in_buf, size_t n) const
+    {
+        using namespace simd_bit_packing;
+        static_assert(sizeof(T) == sizeof(uint32_t), "simd_pfor encodes 32-bit integers");
+        const uint32_t* in = (const uint32_t*)in_buf;
+        os.expand_if_needed(8 + 8 * ((n / block_len) * (2 + 16 * 32) + 5 * (n % block_len)));
+        os.align8();
+        uint8_t* start = os.cur_data8();
+        uint8_t* out = start;
+        size_t i = 0;
+        for (; i + block_len <= n; i += block_len) {
+            auto b = best_width(in + i);
+            uint8_t* num_exceptions = out + 1;
+            out[0] = b;
+            out[1] = 0;
+            out += 2;
+            pack(in + i, out, b);
+            out += 16 * b;
+            for (size_t j = 0; j < block_len; j++) {
+                if (bits(in[i + j]) > b) {
+                    (*num_exceptions)++;
+                    *out++ = j;
+                    put_vbyte(out, in[i + j] >> b);
+                }
+            }
+        }
+        for (; i < n; i++)
+            put_vbyte(out, in[i]);
+        os.skip(8 * (out - start));
+    }
+    template <class t_bit_istream, class T>
+    inline void decode(const t_bit_istream& is, T* out_buf, size_t n) const
+    {
+        using namespace simd_bit_packing;
+        static_assert(sizeof(T) == sizeof(uint32_t), "simd_pfor decodes 32-bit integers");
+        uint32_t* out = (uint32_t*)out_buf;
+        is.align8();
+        const uint8_t* start = is.cur_data8();
+        const uint8_t* in = start;
+        size_t i = 0;
+        for (; i + block_len <= n; i += block_len) {
+            uint32_t b = in[0];
+            uint32_t num_exceptions = in[1];
+            in += 2;
+            unpack(in, out + i, b);
+            in += 16 * b;
+            for (uint32_t j = 0; j < num_exceptions; j++) {
+                auto pos = *in++;
+                out[i + pos] |= get_vbyte(in) << b;
+            }
+        }
+        for (; i < n; i++)
+            out[i] = get_vbyte(in);
+        is.skip(8 * (in - start));
+    }
+};
+
+/*
+    interleaved rANS (byte-wise renormalization, as in ryg_rans) over t_states
+    states. values are mapped to one of 72 symbols: 0..15 stand for
+    themselves, larger values by their bit width and the bit after the
+    leading one. the remaining low bits are stored raw after the rANS bytes,
+    so for offsets only the high bits are entropy coded. each call stores
+    its own frequency table (scaled to 2^12) in front of the rANS bytes.
+
+    layout (byte aligned): 32-bit size of table and rANS bytes, presence
+    mask of the symbols (9 bytes), vbyte coded frequencies of the present
+    symbols, the rANS states and bytes, then the raw bits.
+ */
+template <uint32_t t_states = 4>
+struct rans {
+    static const uint32_t num_syms = 72;
+    static const uint32_t scale_bits = 12;
+    static const uint32_t prob_scale = 1 << scale_bits;
+    static const uint32_t rans_l = 1 << 23;
+
+    static std::string type()
+    {
+        return "rans" + std::to_string(t_states);
+    }
+
+    static inline uint32_t symbol(uint32_t x)
+    {
+        if (x < 16)
+            return x;
+        uint32_t w = 32 - __builtin_clz(x);
+        return 16 + 2 * (w - 5) + ((x >> (w - 2)) & 1);
+    }
+    static inline uint32_t raw_bits(uint32_t sym)
+    {
+        return sym < 16 ? 0 : (sym - 16) / 2 + 3;
+    }
+    static inline uint32_t symbol_base(uint32_t sym)
+    {
+        if (sym < 16)
+            return sym;
+        uint32_t w = (sym - 16) / 2 + 5;
+        return (1U << (w - 1)) | ((sym & 1) << (w - 2));
+    }
+
+    /* scale the counts to sum up to prob_scale, present symbols keep a frequency >= 1 */
+    static void normalize(const uint32_t* count, uint32_t* freq, size_t n)
+    {
+        uint32_t sum = 0;
+        uint32_t max_sym = 0;
+        for (uint32_t s = 0; s < num_syms; s++) {
+            freq[s] = count[s] ? std::max((uint64_t)1, (uint64_t)count[s] * prob_scale / n) : 0;
+            sum += freq[s];
+            if (count[s] > count[max_sym])
+                max_sym = s;
+        }
+        freq[max_sym] += prob_scale - sum; // at most 72 symbols were rounded up, so this stays positive
+    }
+
+    static void cumulative(const uint32_t* freq, uint32_t* start)
+    {
+        for (uint32_t s = 0, cum = 0; s < num_syms; s++) {
+            start[s] = cum;
+            cum += freq[s];
+        }
+    }
+
+    /* writes the 32-bit size of header and rANS bytes, the header, the rANS
+       bytes of in_buf[0..n) under freq and the raw bits */
+    template <class t_bit_ostream, class T>
+    static void encode(t_bit_ostream& os, const T* in_buf, size_t n, const uint32_t* freq,
+        const std::vector<uint8_t>& header)
+    {
+        uint32_t start[num_syms];
+        cumulative(freq, start);
+
+        /* the rANS bytes are produced back to front */
+        std::vector<uint8_t> buf(4 * n + 4 * t_states + 16);
+        uint8_t* end = buf.data() + buf.size();
+        uint8_t* ptr = end;
+        uint32_t x[t_states];
+        for (auto& state : x)
+            state = rans_l;
+        uint64_t raw = 0;
+        for (size_t i = n; i-- > 0;) {
+            auto sym = symbol(in_buf[i]);
+            auto& state = x[i % t_states];
+            uint32_t x_max = ((rans_l >> scale_bits) << 8) * freq[sym];
+            while (state >= x_max) {
+                *--ptr = state & 0xFF;
+                state >>= 8;
+            }
+            state = ((state / freq[sym]) << scale_bits) + (state % freq[sym]) + start[sym];
+            raw += raw_bits(sym);
+        }
+        for (size_t s = t_states; s-- > 0;) {
+            ptr -= 4;
+            std::memcpy(ptr, &x[s], 4);
+        }
+
+        uint32_t size = header.size() + (end - ptr);
+        os.expand_if_needed(8 * (4 + size) + raw + 64);
+        os.align8();
+        uint8_t* out = os.cur_data8();
+        std::memcpy(out, &size, 4);
+        if (!header.empty())
+            std::memcpy(out + 4, header.data(), header.size());
+        std::memcpy(out + 4 + header.size(), ptr, end - ptr);
+        os.skip(8 * (4 + size));
+        for (size_t i = 0; i < n; i++) {
+            auto b = raw_bits(symbol(in_buf[i]));
+            if (b)
+                os.put_int_no_size_check(in_buf[i] & ((1U << b) - 1), b);
+        }
+    }
+
+    /* decodes the rANS bytes starting at in and then the raw bits from is */
+    template <class t_bit_istream, class T>
+    static void decode(const t_bit_istream& is, const uint8_t* in, T* out_buf, size_t n, const uint32_t* freq,
+        const uint32_t* start, const uint8_t* slot_sym)
+    {
+        uint32_t x[t_states];
+        for (auto& state : x) {
+            std::memcpy(&state, in, 4);
+            in += 4;
+        }
+        for (size_t i = 0; i < n; i++) {
+            auto& state = x[i % t_states];
+            uint32_t slot = state & (prob_scale - 1);
+            uint32_t sym = slot_sym[slot];
+            state = freq[sym] * (state >> scale_bits) + slot - start[sym];
+            while (state < rans_l)
+                state = (state << 8) | *in++;
+            out_buf[i] = symbol_base(sym);
+        }
+        for (size_t i = 0; i < n; i++) { // raw bits follow the rANS bytes
+            auto b = raw_bits(symbol(out_buf[i]));
+            if (b)
+                out_buf[i] |= is.get_int(b);
+        }
+    }
+
+    template <class t_bit_ostream, class T>
+    inline void encode(t_bit_ostream& os, const T* in_buf, size_t n) const
+    {
+        using namespace simd_bit_packing;
+        static_assert(sizeof(T) <= sizeof(uint32_t), "rans encodes 32-bit integers");
+        if (n == 0)
+            return;
+        uint32_t count[num_syms] = { 0 };
+        for (size_t i = 0; i < n; i++)
+            count[symbol(in_buf[i])]++;
+        uint32_t freq[num_syms];
+        normalize(count, freq, n);
+
+        std::vector<uint8_t> header(9 + 2 * num_syms, 0);
+        uint8_t* out = header.data() + 9;
+        for (uint32_t s = 0; s < num_syms; s++) {
+            if (freq[s]) {
+                header[s / 8] |= 1 << (s % 8);
+                put_vbyte(out, freq[s] - 1);
+            }
+        }
+        header.resize(out - header.data());
+        encode(os, in_buf, n, freq, header);
+    }
+    template <class t_bit_istream, class T>
+    inline void decode(const t_bit_istream& is, T* out_buf, size_t n) const
+    {
+        using namespace simd_bit_packing;
+        static_assert(sizeof(T) <= sizeof(uint32_t), "rans decodes 32-bit integers");
+        if (n == 0)
+            return;
+        is.align8();
+        const uint8_t* in = is.cur_data8();
+        uint32_t size;
+        std::memcpy(&size, in, 4);
+        in += 4;
+        is.skip(8 * (4 + size));
+
+        uint32_t freq[num_syms];
+        uint32_t start[num_syms];
+        uint8_t slot_sym[prob_scale];
+        const uint8_t* mask = in;
+        in += 9;
+        for (uint32_t s = 0, cum = 0; s < num_syms; s++) {
+            freq[s] = (mask[s / 8] >> (s % 8)) & 1 ? get_vbyte(in) + 1 : 0;
+            start[s] = cum;
+            std::memset(slot_sym + cum, s, freq[s]);
+            cum += freq[s];
+        }
+        decode(is, in, out_buf, n, freq, start, slot_sym);
+    }
+};
+
+/*
+    rans with one frequency table for all blocks, trained on sample blocks
+    during construction and stored with the factorization (see
+    factor_coder_blocked::train). blocks only store the 32-bit size and the
+    rANS bytes. every symbol keeps a frequency >= 1, so values not seen in
+    training can still be coded. without a model all symbols are equally
+    likely.
+ */
+template <uint32_t t_states = 4>
+struct rans_static {
+    enum { trainable = 1 };
+    typedef rans<t_states> rans_type;
+    static const uint32_t num_syms = rans_type::num_syms;
+    static const uint32_t prob_scale = rans_type::prob_scale;
+
+private:
+    struct table {
+        uint32_t freq[num_syms];
+        uint32_t start[num_syms];
+        uint8_t slot_sym[prob_scale];
+    };
+    std::shared_ptr<const table> m_table;
+
+public:
+    static std::string type()
+    {
+        return "ransS" + std::to_string(t_states);
+    }
+
+    rans_static()
+    {
+        uint32_t count[num_syms];
+        std::fill(count, count + num_syms, 1);
+        set_freq(count, num_syms);
+    }
+
+    void set_freq(const uint32_t* count, size_t n)
+    {
+        auto t = std::make_shared<table>();
+        rans_type::normalize(count, t->freq, n);
+        rans_type::cumulative(t->freq, t->start);
+        for (uint32_t s = 0; s < num_syms; s++)
+            std::memset(t->slot_sym + t->start[s], s, t->freq[s]);
+        m_table = t;
+    }
+
+    /* the model is the symbol counts of the samples (plus one) as 32-bit integers */
+    template <class T>
+    static std::vector<uint8_t> train(const std::vector<std::vector<T> >& samples)
+    {
+        std::vector<uint32_t> count(num_syms, 1);
+        for (const auto& sample : samples) {
+            for (auto x : sample)
+                count[rans_type::symbol(x)]++;
+        }
+        std::vector<uint8_t> model(num_syms * sizeof(uint32_t));
+        std::memcpy(model.data(), count.data(), model.size());
+        return model;
+    }
+
+    void set_model(const std::vector<uint8_t>& model)
+    {
+        if (model.size() != num_syms * sizeof(uint32_t)) {
+            LOG(FATAL) << "rans_static: invalid model size " << model.size();
+        }
+        uint32_t count[num_syms];
+        std::memcpy(count, model.data(), model.size());
+        uint64_t n = 0;
+        for (auto c : count)
+            n += c;
+        /* normalize() needs a total of at most 2^32 */
+        while (n >= (1ULL << 32)) {
+            n = 0;
+            for (auto& c : count) {
+                c = std::max(c / 2, 1U);
+                n += c;
+            }
+        }
+        set_freq(count, n);
+    }
+
+    template <class t_bit_ostream, class T>
+    inline void encode(t_bit_ostream& os, const T* in_buf, size_t n) const
+    {
+        static_assert(sizeof(T) <= sizeof(uint32_t), "rans_static encodes 32-bit integers");
+        if (n == 0)
+            return;
+        rans_type::encode(os, in_buf, n, m_table->freq, std::vector<uint8_t>());
+    }
+    template <class t_bit_istream, class T>
+    inline void decode(const t_bit_istream& is, T* out_buf, size_t n) const
+    {
+        static_assert(sizeof(T) <= sizeof(uint32_t), "rans_static decodes 32-bit integers");
+        if (n == 0)
+            return;
+        is.align8();
+        const uint8_t* in = is.cur_data8();
+        uint32_t size;
+        std::memcpy(&size, in, 4);
+        is.skip(8 * (4 + size));
+        rans_type::decode(is, in + 4, out_buf, n, m_table->freq, m_table->start, m_table->slot_sym);
+    }
+};
+
+/*
+    estimated number of bits a coder spends on the value x, used by the cost
+    based parsing. the general purpose compressors get the binary length.
+ */
+template <class t_coder>
+inline uint64_t value_bits(const t_coder&, uint64_t x)
+{
+    return x ? sdsl::bits::hi(x) + 1 : 1;
+}
+inline uint64_t value_bits(const vbyte& c, uint64_t x)
+{
+    return c.encoded_length(x);
+}
+template <uint8_t t_width>
+inline uint64_t value_bits(const fixed<t_width>&, uint64_t)
+{
+    return t_width;
+}
+template <class t_int_type>
+inline uint64_t value_bits(const aligned_fixed<t_int_type>&, uint64_t)
+{
+    return 8 * sizeof(t_int_type);
+}
+
 template <uint8_t t_level = 6>
 struct zlib {
 public:
@@ -161,6 +700,9 @@ private:
     mutable z_stream dstrm;
     mutable z_stream istrm;
 
+protected:
+    std::shared_ptr<const std::vector<uint8_t> > m_preset_dict; // see zlib_dict
+
 public:
     zlib()
     {
@@ -212,6 +754,8 @@ public:
         dstrm.next_in = (uint8_t*)in_buf;
         dstrm.next_out = out_buf;
 
+        if (m_preset_dict)
+            deflateSetDictionary(&dstrm, m_preset_dict->data(), m_preset_dict->size());
         auto error = deflate(&dstrm, Z_FINISH);
         deflateReset(&dstrm); // after finish we have to reset
 
@@ -267,6 +811,10 @@ public:
         istrm.next_out = (uint8_t*)out_buf;
 
         auto error = inflate(&istrm, Z_FINISH);
+        if (error == Z_NEED_DICT && m_preset_dict) {
+            inflateSetDictionary(&istrm, m_preset_dict->data(), m_preset_dict->size());
+            error = inflate(&istrm, Z_FINISH);
+        }
         inflateReset(&istrm); // after finish we need to reset
         if (error != Z_STREAM_END) {
             switch (error) {
@@ -295,6 +843,89 @@ public:
     }
 };
 
+/*
+    zlib with a preset dictionary shared by all blocks, so the first bytes of
+    a block can already refer to typical content instead of starting from an
+    empty window. the dictionary is built from pieces of equal size taken
+    from the front of the streams of sample blocks during construction and
+    stored with the factorization (see factor_coder_blocked::train). without
+    a model this is plain zlib.
+ */
+template <uint8_t t_level = 6, uint32_t t_dict_bytes = 32 * 1024>
+struct zlib_dict : public zlib<t_level> {
+    enum { trainable = 1 };
+    static_assert(t_dict_bytes <= (1U << zlib<t_level>::window_bits), "zlib only uses the last window of the dictionary");
+
+    static std::string type()
+    {
+        return "zlibd-" + std::to_string(t_level) + "-" + std::to_string(t_dict_bytes / 1024);
+    }
+
+    template <class T>
+    static std::vector<uint8_t> train(const std::vector<std::vector<T> >& samples)
+    {
+        std::vector<uint8_t> dict;
+        if (samples.empty())
+            return dict;
+        size_t piece_bytes = std::max(t_dict_bytes / samples.size(), (size_t)1);
+        for (const auto& sample : samples) {
+            const uint8_t* bytes = (const uint8_t*)sample.data();
+            size_t len = std::min(piece_bytes, std::min(sample.size() * sizeof(T), t_dict_bytes - dict.size()));
+            dict.insert(dict.end(), bytes, bytes + len);
+        }
+        return dict;
+    }
+
+    void set_model(const std::vector<uint8_t>& model)
+    {
+        if (model.empty())
+            this->m_preset_dict.reset();
+        else
+            this->m_preset_dict = std::make_shared<const std::vector<uint8_t> >(model);
+    }
+};
+
+/* coders with a shared model trained on sample blocks (rans_static, zlib_dict) */
+template <class t_coder, class = void>
+struct is_trainable : std::false_type {
+};
+
+template <class t_coder>
+struct is_trainable<t_coder, typename std::enable_if<t_coder::trainable>::type> : std::true_type {
+};
+
+/* the model of t_coder trained on samples, empty for coders without a model */
+template <class t_coder, class T>
+inline std::vector<uint8_t> train_model(const std::vector<std::vector<T> >& samples, std::true_type)
+{
+    return t_coder::train(samples);
+}
+template <class t_coder, class T>
+inline std::vector<uint8_t> train_model(const std::vector<std::vector<T> >&, std::false_type)
+{
+    return std::vector<uint8_t>();
+}
+template <class t_coder, class T>
+inline std::vector<uint8_t> train_model(const std::vector<std::vector<T> >& samples)
+{
+    return train_model<t_coder>(samples, is_trainable<t_coder>());
+}
+
+template <class t_coder>
+inline void set_model(t_coder& c, const std::vector<uint8_t>& model, std::true_type)
+{
+    c.set_model(model);
+}
+template <class t_coder>
+inline void set_model(t_coder&, const std::vector<uint8_t>&, std::false_type)
+{
+}
+template <class t_coder>
+inline void set_model(t_coder& c, const std::vector<uint8_t>& model)
+{
+    set_model(c, model, is_trainable<t_coder>());
+}
+
 template <uint8_t t_level = 9>
 struct lz4hc {
 private:
@@ -156,7 +156,7 @@ public:
     {
         auto mod = in_word_offset % 8;
         if (mod != 0) {
-            in_word_offset += mod;
+            in_word_offset += (8 - mod);
             if (in_word_offset >= 64) {
                 data_ptr++;
                 in_word_offset = 0;
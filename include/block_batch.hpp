@@ -0,0 +1,85 @@
+#pragma once
+
+#include "utils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+
+/*
+    prefetch the encoded bits of the given (sorted, unique) blocks. runs of
+    consecutive blocks are merged into a single madvise call.
+ */
+template <class t_block_map, class t_encoding>
+void prefetch_encoded_blocks(const t_block_map& block_map, const t_encoding& encoding,
+    const std::vector<uint64_t>& sorted_ids)
+{
+    const uint8_t* base = (const uint8_t*)encoding.data();
+    size_t i = 0;
+    while (i < sorted_ids.size()) {
+        auto first = sorted_ids[i];
+        auto last = first;
+        while (i + 1 < sorted_ids.size() && sorted_ids[i + 1] == last + 1) {
+            last++;
+            i++;
+        }
+        i++;
+        uint64_t begin_bits = block_map.block_offset(first);
+        uint64_t end_bits = encoding.size();
+        if (last + 1 < block_map.num_blocks())
+            end_bits = block_map.block_offset(last + 1);
+        utils::advise_willneed(base + begin_bits / 8, (end_bits + 7) / 8 - begin_bits / 8);
+    }
+}
+
+/*
+    decode a batch of blocks of a store. the ids are sorted and deduplicated
+    (blocks are stored in id order, so this is also file order), their encoded
+    data is prefetched and the blocks are decoded by up to num_threads workers,
+    each using its own decode context. callback(id, content) is then called from
+    the calling thread once for every requested id, in request order.
+
+    the workers are started per call (std::async) and each builds a decode
+    context, which costs tens of microseconds per thread. this only pays off
+    for batches of several blocks, so at most one worker is used per
+    min_blocks_per_worker blocks; small batches are decoded by the caller alone.
+    callers issuing many small batches should pass num_threads = 1.
+ */
+const size_t min_blocks_per_worker = 4;
+
+template <class t_store, class t_callback>
+void decode_blocks_batched(const t_store& store, const std::vector<uint64_t>& ids, t_callback callback,
+    size_t num_threads)
+{
+    using decode_context = typename t_store::decode_context;
+    std::vector<uint64_t> sorted_ids(ids);
+    std::sort(sorted_ids.begin(), sorted_ids.end());
+    sorted_ids.erase(std::unique(sorted_ids.begin(), sorted_ids.end()), sorted_ids.end());
+    store.prefetch_blocks(sorted_ids);
+
+    std::vector<std::vector<uint8_t> > contents(sorted_ids.size());
+    std::atomic<size_t> next_block(0);
+    auto worker = [&] {
+        decode_context ctx(store);
+        size_t i;
+        while ((i = next_block++) < sorted_ids.size()) {
+            contents[i] = store.block(sorted_ids[i], ctx);
+        }
+    };
+    num_threads = std::min(num_threads, sorted_ids.size() / min_blocks_per_worker);
+    num_threads = std::max((size_t)1, num_threads);
+    std::vector<std::future<void> > workers;
+    for (size_t t = 1; t < num_threads; t++) {
+        workers.push_back(std::async(std::launch::async, worker));
+    }
+    worker();
+    for (auto& w : workers)
+        w.get();
+
+    for (const auto& id : ids) {
+        auto itr = std::lower_bound(sorted_ids.begin(), sorted_ids.end(), id);
+        callback(id, contents[std::distance(sorted_ids.begin(), itr)]);
+    }
+}
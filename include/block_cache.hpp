@@ -0,0 +1,246 @@
+#pragma once
+
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+    cache of decoded blocks. the cache is split into independently locked
+    shards (block_id % num_shards) so concurrent readers rarely contend.
+    each shard gets an equal share of the byte budget and evicts with the
+    given policy once it is exceeded. blocks are handed out as shared
+    pointers so a reader can keep using a block after it was evicted.
+ */
+
+using cached_block_ptr = std::shared_ptr<const std::vector<uint8_t> >;
+
+struct block_cache_stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t cached_blocks = 0;
+    uint64_t cached_bytes = 0;
+};
+
+/* least recently used. every hit moves the block to the front of the list */
+class cache_policy_lru {
+private:
+    using entry_type = std::pair<uint64_t, cached_block_ptr>;
+    std::list<entry_type> m_order; // front = most recently used
+    std::unordered_map<uint64_t, std::list<entry_type>::iterator> m_map;
+
+public:
+    static std::string type()
+    {
+        return "lru";
+    }
+
+    bool find(uint64_t block_id, cached_block_ptr& block)
+    {
+        auto itr = m_map.find(block_id);
+        if (itr == m_map.end())
+            return false;
+        m_order.splice(m_order.begin(), m_order, itr->second);
+        block = itr->second->second;
+        return true;
+    }
+
+    void insert(uint64_t block_id, cached_block_ptr block)
+    {
+        m_order.emplace_front(block_id, std::move(block));
+        m_map[block_id] = m_order.begin();
+    }
+
+    /* returns the number of bytes freed */
+    uint64_t evict()
+    {
+        auto& victim = m_order.back();
+        uint64_t freed = victim.second->size();
+        m_map.erase(victim.first);
+        m_order.pop_back();
+        return freed;
+    }
+
+    size_t size() const
+    {
+        return m_map.size();
+    }
+
+    void clear()
+    {
+        m_order.clear();
+        m_map.clear();
+    }
+};
+
+/* CLOCK (second chance). a hit only sets the reference bit of the slot */
+class cache_policy_clock {
+private:
+    struct slot {
+        uint64_t block_id;
+        cached_block_ptr block;
+        bool referenced;
+    };
+    std::vector<slot> m_slots;
+    std::vector<size_t> m_free_slots;
+    std::unordered_map<uint64_t, size_t> m_map;
+    size_t m_hand = 0;
+
+public:
+    static std::string type()
+    {
+        return "clock";
+    }
+
+    bool find(uint64_t block_id, cached_block_ptr& block)
+    {
+        auto itr = m_map.find(block_id);
+        if (itr == m_map.end())
+            return false;
+        auto& s = m_slots[itr->second];
+        s.referenced = true;
+        block = s.block;
+        return true;
+    }
+
+    void insert(uint64_t block_id, cached_block_ptr block)
+    {
+        size_t pos = m_slots.size();
+        if (!m_free_slots.empty()) {
+            pos = m_free_slots.back();
+            m_free_slots.pop_back();
+        }
+        else {
+            m_slots.emplace_back();
+        }
+        m_slots[pos].block_id = block_id;
+        m_slots[pos].block = std::move(block);
+        m_slots[pos].referenced = false;
+        m_map[block_id] = pos;
+    }
+
+    /* returns the number of bytes freed */
+    uint64_t evict()
+    {
+        while (true) {
+            if (m_hand == m_slots.size())
+                m_hand = 0;
+            auto& s = m_slots[m_hand];
+            if (s.block != nullptr) {
+                if (!s.referenced)
+                    break;
+                s.referenced = false;
+            }
+            m_hand++;
+        }
+        auto& victim = m_slots[m_hand];
+        uint64_t freed = victim.block->size();
+        m_map.erase(victim.block_id);
+        victim.block.reset();
+        m_free_slots.push_back(m_hand);
+        m_hand++;
+        return freed;
+    }
+
+    size_t size() const
+    {
+        return m_map.size();
+    }
+
+    void clear()
+    {
+        m_slots.clear();
+        m_free_slots.clear();
+        m_map.clear();
+        m_hand = 0;
+    }
+};
+
+template <class t_policy = cache_policy_lru>
+class block_cache {
+private:
+    struct shard {
+        std::mutex mutex;
+        t_policy policy;
+        block_cache_stats stats;
+    };
+    std::vector<std::unique_ptr<shard> > m_shards;
+    uint64_t m_shard_budget_bytes;
+
+public:
+    static std::string type()
+    {
+        return "block_cache-" + t_policy::type();
+    }
+
+    block_cache(uint64_t budget_bytes, size_t num_shards = 16)
+        : m_shard_budget_bytes(budget_bytes / std::max(num_shards, (size_t)1))
+    {
+        for (size_t i = 0; i < std::max(num_shards, (size_t)1); i++)
+            m_shards.emplace_back(new shard());
+    }
+    block_cache(const block_cache&) = delete;
+    block_cache& operator=(const block_cache&) = delete;
+
+    /*
+        return the cached block or call decode() to produce it. decoding
+        happens outside the shard lock, so two threads missing on the same
+        block may both decode it; the first one to finish wins.
+     */
+    template <class t_decode_fn>
+    cached_block_ptr get(uint64_t block_id, t_decode_fn decode)
+    {
+        auto& s = *m_shards[block_id % m_shards.size()];
+        cached_block_ptr block;
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if (s.policy.find(block_id, block)) {
+                s.stats.hits++;
+                return block;
+            }
+            s.stats.misses++;
+        }
+        block = std::make_shared<const std::vector<uint8_t> >(decode());
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            cached_block_ptr existing;
+            if (s.policy.find(block_id, existing))
+                return existing;
+            s.policy.insert(block_id, block);
+            s.stats.cached_bytes += block->size();
+            while (s.stats.cached_bytes > m_shard_budget_bytes && s.policy.size() > 1) {
+                s.stats.cached_bytes -= s.policy.evict();
+                s.stats.evictions++;
+            }
+            s.stats.cached_blocks = s.policy.size();
+        }
+        return block;
+    }
+
+    block_cache_stats stats() const
+    {
+        block_cache_stats total;
+        for (const auto& s : m_shards) {
+            std::lock_guard<std::mutex> lock(s->mutex);
+            total.hits += s->stats.hits;
+            total.misses += s->stats.misses;
+            total.evictions += s->stats.evictions;
+            total.cached_blocks += s->stats.cached_blocks;
+            total.cached_bytes += s->stats.cached_bytes;
+        }
+        return total;
+    }
+
+    void clear()
+    {
+        for (auto& s : m_shards) {
+            std::lock_guard<std::mutex> lock(s->mutex);
+            s->policy.clear();
+            s->stats = block_cache_stats();
+        }
+    }
+};
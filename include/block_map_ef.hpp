@@ -0,0 +1,147 @@
+#pragma once
+
+#include "collection.hpp"
+
+#include <sdsl/int_vector.hpp>
+#include <sdsl/sd_vector.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/*
+    block map storing the monotone block offsets Elias-Fano coded (sd_vector)
+    and the factor counts in a bit-compressed array. offset i is stored as
+    offset + i so the encoded sequence is strictly increasing even if a block
+    takes no space. variable block text starts are stored the same way.
+ */
+struct block_map_ef {
+    typedef typename sdsl::int_vector<>::size_type size_type;
+
+    sdsl::sd_vector<> m_block_offsets;
+    sdsl::sd_vector<>::select_1_type m_block_offsets_select;
+    sdsl::int_vector<> m_block_factors;
+    sdsl::sd_vector<> m_block_starts;
+    sdsl::sd_vector<>::select_1_type m_block_starts_select;
+    sdsl::sd_vector<>::rank_1_type m_block_starts_rank;
+    uint64_t m_num_blocks = 0;
+    bool m_variable_block_sizes = false;
+
+    static std::string type()
+    {
+        return "block_map_ef";
+    }
+
+    block_map_ef() = default;
+    block_map_ef(block_map_ef&& bm)
+    {
+        *this = std::move(bm);
+    }
+    block_map_ef& operator=(block_map_ef&& bm)
+    {
+        if (this != &bm) {
+            m_block_offsets = std::move(bm.m_block_offsets);
+            m_block_offsets_select = std::move(bm.m_block_offsets_select);
+            m_block_offsets_select.set_vector(&m_block_offsets);
+            m_block_factors = std::move(bm.m_block_factors);
+            m_block_starts = std::move(bm.m_block_starts);
+            m_block_starts_select = std::move(bm.m_block_starts_select);
+            m_block_starts_select.set_vector(&m_block_starts);
+            m_block_starts_rank = std::move(bm.m_block_starts_rank);
+            m_block_starts_rank.set_vector(&m_block_starts);
+            m_num_blocks = bm.m_num_blocks;
+            m_variable_block_sizes = bm.m_variable_block_sizes;
+        }
+        return *this;
+    }
+
+    block_map_ef(collection& col)
+    {
+        LOG(INFO) << "\tLoad block offsets from file";
+        {
+            const sdsl::int_vector_mapper<0, std::ios_base::in> block_offsets(col.file_map[KEY_BLOCKOFFSETS]);
+            m_num_blocks = block_offsets.size();
+            std::vector<uint64_t> shifted(m_num_blocks);
+            for (size_t i = 0; i < m_num_blocks; i++)
+                shifted[i] = block_offsets[i] + i;
+            m_block_offsets = sdsl::sd_vector<>(shifted.begin(), shifted.end());
+        }
+        if (col.file_map.find(KEY_BLOCKFACTORS) != col.file_map.end()) {
+            sdsl::load_from_file(m_block_factors, col.file_map[KEY_BLOCKFACTORS]);
+            sdsl::util::bit_compress(m_block_factors);
+        }
+        if (col.file_map.find(KEY_BLOCKSTARTS) != col.file_map.end()) {
+            LOG(INFO) << "\tLoad block text starts from file";
+            sdsl::int_vector<> block_starts;
+            sdsl::load_from_file(block_starts, col.file_map[KEY_BLOCKSTARTS]);
+            std::vector<uint64_t> starts(block_starts.begin(), block_starts.end());
+            m_block_starts = sdsl::sd_vector<>(starts.begin(), starts.end());
+            m_variable_block_sizes = true;
+        }
+        sdsl::util::init_support(m_block_offsets_select, &m_block_offsets);
+        sdsl::util::init_support(m_block_starts_select, &m_block_starts);
+        sdsl::util::init_support(m_block_starts_rank, &m_block_starts);
+    }
+
+    inline size_type serialize(std::ostream& out, sdsl::structure_tree_node* v = NULL, std::string name = "") const
+    {
+        using namespace sdsl;
+        structure_tree_node* child = structure_tree::add_child(v, name, sdsl::util::class_name(*this));
+        size_type written_bytes = 0;
+        written_bytes += m_block_offsets.serialize(out, child, "offsets");
+        written_bytes += m_block_offsets_select.serialize(out, child, "offsets_select");
+        written_bytes += m_block_factors.serialize(out, child, "num_factors");
+        written_bytes += m_block_starts.serialize(out, child, "block_starts");
+        written_bytes += m_block_starts_select.serialize(out, child, "block_starts_select");
+        written_bytes += m_block_starts_rank.serialize(out, child, "block_starts_rank");
+        written_bytes += sdsl::write_member(m_num_blocks, out, child, "num_blocks");
+        written_bytes += sdsl::write_member(m_variable_block_sizes, out, child, "variable_block_sizes");
+        sdsl::structure_tree::add_size(child, written_bytes);
+        return written_bytes;
+    }
+
+    size_type size_in_bytes() const
+    {
+        return sdsl::size_in_bytes(*this);
+    }
+
+    inline void load(std::istream& in)
+    {
+        m_block_offsets.load(in);
+        m_block_offsets_select.load(in, &m_block_offsets);
+        m_block_factors.load(in);
+        m_block_starts.load(in);
+        m_block_starts_select.load(in, &m_block_starts);
+        m_block_starts_rank.load(in, &m_block_starts);
+        sdsl::read_member(m_num_blocks, in);
+        sdsl::read_member(m_variable_block_sizes, in);
+    }
+
+    inline size_type block_offset(size_t block_id) const
+    {
+        return m_block_offsets_select(block_id + 1) - block_id;
+    }
+    inline size_type block_factors(size_t block_id) const
+    {
+        return m_block_factors[block_id];
+    }
+
+    inline bool variable_block_sizes() const
+    {
+        return m_variable_block_sizes;
+    }
+    inline size_type block_text_start(size_t block_id) const
+    {
+        return m_block_starts_select(block_id + 1);
+    }
+    inline size_type block_containing(size_type pos) const
+    {
+        auto pos_rank = std::min(pos + 1, (size_type)m_block_starts.size());
+        return m_block_starts_rank(pos_rank) - 1;
+    }
+
+    inline size_type num_blocks() const
+    {
+        return m_num_blocks;
+    }
+};
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "collection.hpp"
+
+#include <sdsl/int_vector.hpp>
+#include <sdsl/int_vector_mapper.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+/*
+    block map that mmaps the block offset/factor (and text start) files written
+    during factorization instead of loading them onto the heap. only the file
+    names are serialized, so loading the block map costs a few mmap calls and
+    the pages are shared between processes through the page cache.
+
+    the names are stored relative to the collection directory, so a collection
+    can be moved or mounted elsewhere. they are resolved against the collection
+    given to load_block_map (see block_maps.hpp). absolute names written by
+    older versions are used as they are.
+ */
+struct block_map_mapped {
+    typedef typename sdsl::int_vector<>::size_type size_type;
+    using mapper_type = sdsl::int_vector_mapper<0, std::ios_base::in>;
+
+    std::string m_block_offsets_file;
+    std::string m_block_factors_file;
+    std::string m_block_starts_file;
+    std::string m_collection_path;
+    std::unique_ptr<mapper_type> m_block_offsets;
+    std::unique_ptr<mapper_type> m_block_factors;
+    std::unique_ptr<mapper_type> m_block_starts;
+
+    static std::string type()
+    {
+        return "block_map_mapped";
+    }
+
+    block_map_mapped() = default;
+    block_map_mapped(block_map_mapped&&) = default;
+    block_map_mapped& operator=(block_map_mapped&&) = default;
+
+    block_map_mapped(collection& col)
+        : m_collection_path(col.path)
+    {
+        m_block_offsets_file = relative_file_name(col, col.file_map[KEY_BLOCKOFFSETS]);
+        if (col.file_map.find(KEY_BLOCKFACTORS) != col.file_map.end()) {
+            m_block_factors_file = relative_file_name(col, col.file_map[KEY_BLOCKFACTORS]);
+        }
+        if (col.file_map.find(KEY_BLOCKSTARTS) != col.file_map.end()) {
+            m_block_starts_file = relative_file_name(col, col.file_map[KEY_BLOCKSTARTS]);
+        }
+        map_files();
+    }
+
+    /* file_name without the collection path, or unchanged if it is outside the collection */
+    static std::string relative_file_name(const collection& col, const std::string& file_name)
+    {
+        if (file_name.compare(0, col.path.size(), col.path) != 0)
+            return file_name;
+        auto rel_start = file_name.find_first_not_of('/', col.path.size());
+        if (rel_start == std::string::npos)
+            return file_name;
+        return file_name.substr(rel_start);
+    }
+
+    std::string resolve_file_name(const std::string& file_name) const
+    {
+        if (file_name.empty() || file_name[0] == '/' || m_collection_path.empty())
+            return file_name;
+        return m_collection_path + "/" + file_name;
+    }
+
+    void map_files()
+    {
+        LOG(INFO) << "\tMap block offsets from file";
+        m_block_offsets.reset(new mapper_type(resolve_file_name(m_block_offsets_file)));
+        if (!m_block_factors_file.empty()) {
+            m_block_factors.reset(new mapper_type(resolve_file_name(m_block_factors_file)));
+        }
+        if (!m_block_starts_file.empty()) {
+            m_block_starts.reset(new mapper_type(resolve_file_name(m_block_starts_file)));
+        }
+    }
+
+    inline size_type serialize(std::ostream& out, sdsl::structure_tree_node* v = NULL, std::string name = "") const
+    {
+        using namespace sdsl;
+        structure_tree_node* child = structure_tree::add_child(v, name, sdsl::util::class_name(*this));
+        size_type written_bytes = 0;
+        written_bytes += sdsl::write_member(m_block_offsets_file, out, child, "offsets_file");
+        written_bytes += sdsl::write_member(m_block_factors_file, out, child, "num_factors_file");
+        written_bytes += sdsl::write_member(m_block_starts_file, out, child, "block_starts_file");
+        sdsl::structure_tree::add_size(child, written_bytes);
+        return written_bytes;
+    }
+
+    /* size of the mapped data, not of the serialized file names */
+    size_type size_in_bytes() const
+    {
+        size_type bytes = 0;
+        if (m_block_offsets)
+            bytes += (m_block_offsets->size() * m_block_offsets->width()) / 8;
+        if (m_block_factors)
+            bytes += (m_block_factors->size() * m_block_factors->width()) / 8;
+        if (m_block_starts)
+            bytes += (m_block_starts->size() * m_block_starts->width()) / 8;
+        return bytes;
+    }
+
+    /* relative names are resolved against the current directory */
+    inline void load(std::istream& in)
+    {
+        load(in, std::string());
+    }
+
+    inline void load(std::istream& in, const std::string& collection_path)
+    {
+        m_collection_path = collection_path;
+        sdsl::read_member(m_block_offsets_file, in);
+        sdsl::read_member(m_block_factors_file, in);
+        sdsl::read_member(m_block_starts_file, in);
+        map_files();
+    }
+
+    inline size_type block_offset(size_t block_id) const
+    {
+        return (*m_block_offsets)[block_id];
+    }
+    inline size_type block_factors(size_t block_id) const
+    {
+        return (*m_block_factors)[block_id];
+    }
+
+    inline bool variable_block_sizes() const
+    {
+        return m_block_starts != nullptr;
+    }
+    inline size_type block_text_start(size_t block_id) const
+    {
+        return (*m_block_starts)[block_id];
+    }
+    inline size_type block_containing(size_type pos) const
+    {
+        auto itr = std::upper_bound(m_block_starts->begin(), m_block_starts->end(), pos);
+        return std::distance(m_block_starts->begin(), itr) - 1;
+    }
+
+    inline size_type num_blocks() const
+    {
+        return m_block_offsets->size();
+    }
+};
@@ -1,16 +1,18 @@
 #pragma once
 
 #include <sdsl/int_vector.hpp>
+#include <algorithm>
 #include <string>
 
 struct block_map_uncompressed {
     typedef typename sdsl::int_vector<>::size_type size_type;
     sdsl::int_vector<> m_block_offsets;
     sdsl::int_vector<> m_block_factors;
+    sdsl::int_vector<> m_block_starts; // text start of each block if block sizes vary
 
     static std::string type()
     {
-        return "block_map_uncompressed";
+        return "block_map_uncompressed_v2"; // v2 stores m_block_starts, older files must not be loaded
     }
 
     block_map_uncompressed() = default;
@@ -25,6 +27,10 @@ struct block_map_uncompressed {
             sdsl::util::bit_compress(m_block_factors);
         }
         sdsl::util::bit_compress(m_block_offsets);
+        if (col.file_map.find(KEY_BLOCKSTARTS) != col.file_map.end()) {
+            LOG(INFO) << "\tLoad block text starts from file";
+            sdsl::load_from_file(m_block_starts, col.file_map[KEY_BLOCKSTARTS]);
+        }
     }
 
     inline size_type serialize(std::ostream& out, sdsl::structure_tree_node* v = NULL, std::string name = "") const
@@ -34,6 +40,7 @@ struct block_map_uncompressed {
         size_type written_bytes = 0;
         written_bytes += m_block_offsets.serialize(out, child, "offsets");
         written_bytes += m_block_factors.serialize(out, child, "num_factors");
+        written_bytes += m_block_starts.serialize(out, child, "block_starts");
         sdsl::structure_tree::add_size(child, written_bytes);
         return written_bytes;
     }
@@ -47,6 +54,7 @@ struct block_map_uncompressed {
     {
         m_block_offsets.load(in);
         m_block_factors.load(in);
+        m_block_starts.load(in);
     }
 
     inline size_type block_offset(size_t block_id) const
@@ -58,6 +66,22 @@ struct block_map_uncompressed {
         return m_block_factors[block_id];
     }
 
+    /* true if the blocks are not all of the factorization block size */
+    inline bool variable_block_sizes() const
+    {
+        return m_block_starts.size() != 0;
+    }
+    inline size_type block_text_start(size_t block_id) const
+    {
+        return m_block_starts[block_id];
+    }
+    /* id of the block containing text position pos (variable block sizes only) */
+    inline size_type block_containing(size_type pos) const
+    {
+        auto itr = std::upper_bound(m_block_starts.begin(), m_block_starts.end(), pos);
+        return std::distance(m_block_starts.begin(), itr) - 1;
+    }
+
     inline size_type num_blocks() const
     {
         return m_block_offsets.size();
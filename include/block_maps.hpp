@@ -1,3 +1,25 @@
 #pragma once
 
-#include "block_map_uncompressed.hpp"
\ No newline at end of file
+#include "block_map_uncompressed.hpp"
+#include "block_map_mapped.hpp"
+#include "block_map_ef.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+/* load the block map of a store. block_map_mapped needs the collection to
+   find the files it maps */
+template <class t_block_map>
+void load_block_map(t_block_map& block_map, collection& col)
+{
+    sdsl::load_from_file(block_map, col.file_map[KEY_BLOCKMAP]);
+}
+
+inline void load_block_map(block_map_mapped& block_map, collection& col)
+{
+    std::ifstream ifs(col.file_map[KEY_BLOCKMAP]);
+    if (!ifs) {
+        throw std::runtime_error("LOAD FAILED: Cannot open block map " + col.file_map[KEY_BLOCKMAP]);
+    }
+    block_map.load(ifs, col.path);
+}
@@ -20,8 +20,16 @@ const std::string KEY_DICT_STATISTICS = "DICT_STATS";
 const std::string KEY_LZ = "LZ";
 const std::string KEY_DOCORDER = "DOCORDER";
 const std::string KEY_URLORDER = "URLORDER";
+const std::string KEY_DOCMAP = "DOCMAP";
+const std::string KEY_BLOCKSTARTS = "BLOCKSTARTS";
 
 const std::string PARAM_DICT_HASH = "DICT_HASH";
+const std::string PARAM_BLOCKING = "BLOCKING";
+const std::string PARAM_MMAP_DICT = "MMAP_DICT";
+const std::string PARAM_MMAP_POPULATE = "MMAP_POPULATE";
+const std::string PARAM_MMAP_HUGEPAGES = "MMAP_HUGEPAGES";
+const std::string PARAM_STREAM_BUFFER = "STREAM_BUFFER";
+const std::string PARAM_ENCODE_THREADS = "ENCODE_THREADS";
 
 struct collection {
     std::string path;
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/*
+    bounded blocking multi producer/multi consumer queue. push blocks while
+    the queue holds capacity elements, pop blocks while it is empty. after
+    close() no more elements are accepted and pop returns false once the
+    queue has been drained.
+ */
+template <class t_elem>
+class concurrent_queue {
+private:
+    std::deque<t_elem> m_elems;
+    size_t m_capacity;
+    bool m_closed = false;
+    std::mutex m_mutex;
+    std::condition_variable m_not_empty;
+    std::condition_variable m_not_full;
+
+public:
+    concurrent_queue(size_t capacity)
+        : m_capacity(std::max(capacity, (size_t)1))
+    {
+    }
+    concurrent_queue(const concurrent_queue&) = delete;
+    concurrent_queue& operator=(const concurrent_queue&) = delete;
+
+    /* returns false if the queue was closed and elem was not added */
+    bool push(t_elem elem)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_full.wait(lock, [this] { return m_closed || m_elems.size() < m_capacity; });
+        if (m_closed)
+            return false;
+        m_elems.push_back(std::move(elem));
+        lock.unlock();
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    /* returns false if the queue is closed and empty */
+    bool pop(t_elem& elem)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_not_empty.wait(lock, [this] { return m_closed || !m_elems.empty(); });
+        if (m_elems.empty())
+            return false;
+        elem = std::move(m_elems.front());
+        m_elems.pop_front();
+        lock.unlock();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_not_empty.notify_all();
+        m_not_full.notify_all();
+    }
+
+    size_t size()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_elems.size();
+    }
+};
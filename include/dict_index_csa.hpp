@@ -4,9 +4,59 @@
 #include <string>
 #include <sdsl/rmq_support.hpp>
 
+#include <algorithm>
+
+/*
+    suffix array intervals of the q-grams of the dictionary in the index of
+    the reverse dictionary, i.e. the interval backward_search reaches after
+    the q symbols s_1..s_q. the key of a q-gram is sum s_i << 8(i-1). the
+    table is either dense (256^q intervals, absent q-grams have sp > ep) or
+    sparse (the sorted keys of the q-grams present in the dictionary).
+ */
+struct qgram_intervals {
+    typedef sdsl::int_vector<>::size_type size_type;
+    uint64_t q = 0;
+    sdsl::int_vector<> keys; // empty if dense
+    sdsl::int_vector<> intervals;
+
+    inline bool find(uint64_t key, uint64_t& sp, uint64_t& ep) const
+    {
+        size_t i = key;
+        if (keys.size() != 0) {
+            auto itr = std::lower_bound(keys.begin(), keys.end(), key);
+            if (itr == keys.end() || *itr != key)
+                return false;
+            i = std::distance(keys.begin(), itr);
+        }
+        sp = intervals[2 * i];
+        ep = intervals[2 * i + 1];
+        return sp <= ep;
+    }
+
+    inline size_type serialize(std::ostream& out, sdsl::structure_tree_node* v = NULL, std::string name = "") const
+    {
+        using namespace sdsl;
+        structure_tree_node* child = structure_tree::add_child(v, name, sdsl::util::class_name(*this));
+        size_type written_bytes = 0;
+        written_bytes += sdsl::serialize(q, out, child, "q");
+        written_bytes += keys.serialize(out, child, "keys");
+        written_bytes += intervals.serialize(out, child, "intervals");
+        sdsl::structure_tree::add_size(child, written_bytes);
+        return written_bytes;
+    }
+
+    inline void load(std::istream& in)
+    {
+        sdsl::read_member(q, in);
+        keys.load(in);
+        intervals.load(in);
+    }
+};
+
 template <class t_csa, class t_itr, bool t_local_search>
 struct factor_itr_csa {
     const t_csa& sa;
+    const qgram_intervals* qgrams;
     t_itr factor_start;
     t_itr itr;
     t_itr start;
@@ -15,15 +65,13 @@ struct factor_itr_csa {
     uint64_t sp;
     uint64_t ep;
     uint64_t len;
-    uint64_t local_offset;
     uint8_t sym;
     bool done;
-    bool local;
     bool debug;
 
-    // std::unordered_map<uint32_t,std::vector<uint32_t>> qgrams;
-    factor_itr_csa(const t_csa& _csa, t_itr begin, t_itr _end, bool dbg = false)
+    factor_itr_csa(const t_csa& _csa, t_itr begin, t_itr _end, bool dbg = false, const qgram_intervals* _qgrams = nullptr)
         : sa(_csa)
+        , qgrams(_qgrams)
         , factor_start(begin)
         , itr(begin)
         , start(begin)
@@ -31,14 +79,11 @@ struct factor_itr_csa {
         , sp(0)
         , ep(_csa.size() - 1)
         , len(0)
-        , local_offset(0)
         , sym(0)
         , done(false)
-        , local(false)
         , debug(dbg)
     {
         find_next_factor();
-        //qgrams.reserve(64000);
     }
     factor_itr_csa& operator++()
     {
@@ -46,68 +91,13 @@ struct factor_itr_csa {
         return *this;
     }
 
-    inline void find_longer_local_factor()
+    /* continue the factorization at position block_pos of the block, e.g.
+       after the factorizor used a local factor instead of the current one */
+    void restart_at(size_t block_pos)
     {
-        local = false;
-        // (1) local search enabled?
-        if (!t_local_search)
-            return;
-        // (2) is the global factor already quite long? are we in the first part of the block?
-        // if( std::distance(start,itr) > 1024 && len >= 20) return;
-
-        // // (3) search for a better factor locally
-        // {
-        //     utils::rlz_timer<std::chrono::nanoseconds> fbt("search q-gram");
-        //     uint32_t qgram = 0; uint8_t* qg8 = (uint8_t*) &qgram;
-        //     qg8[0] = *factor_start; qg8[1] = *(factor_start+1); qg8[2] = *(factor_start+2);  qg8[3] = *(factor_start+3);
-        //     auto qitr = qgrams.find(qgram);
-        //     if( qitr != qgrams.end()) { // found the qgram at the start of the current factor?
-        //         const auto& qpos = qitr->second;
-        //         bool found = false;
-        //         size_t max_match_len = 0;
-        //         local_offset = 0;
-        //         for(const auto& p : qpos) { // check all pos of qgram for better matches
-        //             auto tmp = start + p;
-        //             auto pitr = factor_start;
-        //             size_t match_len = 0;
-        //             while(tmp != factor_start && pitr != end && *tmp == *pitr) {
-        //                 match_len++;
-        //                 ++tmp;
-        //                 ++pitr;
-        //             }
-        //             if(match_len > max_match_len) {
-        //                 local_offset = p;
-        //                 max_match_len = match_len;
-        //                 found = true;
-        //             }
-        //         }
-        //         if(found && max_match_len > len) {
-        //             local = true;
-        //             len = max_match_len;
-        //             itr = factor_start + len;
-        //         }
-        //     }
-        // }
-        // // (4) update the local q-gram index
-        // {
-        //     utils::rlz_timer<std::chrono::nanoseconds> fbt("update q-gram");
-        //     uint32_t qgram = 0; uint8_t* qg8 = (uint8_t*) &qgram;
-        //     auto tmp = factor_start;
-        //     size_t syms_seen = 0;
-        //     while(tmp != itr) {
-        //         qg8[syms_seen] = *tmp;
-        //         syms_seen++;
-        //         if(syms_seen == 4) {
-        //             auto offset = std::distance(start,tmp) - 3;
-        //             qgrams[qgram].push_back(offset);
-        //             qg8[0] = qg8[1];
-        //             qg8[1] = qg8[2];
-        //             qg8[2] = qg8[3];
-        //             syms_seen = 3;
-        //         }
-        //         ++tmp;
-        //     }
-        // }
+        itr = start + block_pos;
+        factor_start = itr;
+        find_next_factor();
     }
 
     inline void find_next_factor()
@@ -116,6 +106,21 @@ struct factor_itr_csa {
         ep = sa.size() - 1;
         if (debug)
             LOG(INFO) << "START FIND NEXT FACTOR [0," << ep << "]";
+        if (qgrams != nullptr && (uint64_t)std::distance(itr, end) >= qgrams->q) {
+            // replace the first q backward search steps by one table lookup
+            uint64_t key = 0;
+            auto tmp = itr;
+            for (size_t i = 0; i < qgrams->q; i++) {
+                key |= uint64_t(*tmp) << (8 * i);
+                ++tmp;
+            }
+            uint64_t res_sp, res_ep;
+            if (qgrams->find(key, res_sp, res_ep)) {
+                sp = res_sp;
+                ep = res_ep;
+                itr = tmp;
+            }
+        }
         while (itr != end) {
             sym = *itr;
             if (debug)
@@ -161,7 +166,6 @@ struct factor_itr_csa {
                 else {
                     // substring not found. but we found a factor!
                 }
-                find_longer_local_factor();
                 factor_start = itr;
                 if (debug)
                     LOG(INFO) << "END FIND NEXT FACTOR!";
@@ -176,7 +180,6 @@ struct factor_itr_csa {
         /* are we in a substring? encode the rest */
         if (factor_start != itr) {
             len = std::distance(factor_start, itr);
-            find_longer_local_factor();
             factor_start = itr;
             return;
         }
@@ -312,6 +315,14 @@ struct dict_index_csa {
         }
     }
 
+    /* index of an in-memory dictionary, terminated by 0 as the dictionary files */
+    explicit dict_index_csa(const sdsl::int_vector<8>& dict)
+    {
+        sdsl::int_vector<8> rdict(dict.size() - 1);
+        std::reverse_copy(dict.begin(), dict.end() - 1, rdict.begin());
+        sdsl::construct_im(sa, rdict, 0); // appends the 0 for suffix sorting
+    }
+
     inline size_type serialize(std::ostream& out, sdsl::structure_tree_node* v = NULL, std::string name = "") const
     {
         using namespace sdsl;
@@ -344,3 +355,116 @@ struct dict_index_csa {
         return true;
     }
 };
+
+/*
+    dict_index_csa with a q-gram interval table (2 <= t_q <= 4) which
+    replaces the first q backward_search steps of each factor by a single
+    lookup. q-grams which are not in the dictionary fall back to the
+    symbol by symbol search, so the factors do not change. t_sparse stores
+    only the q-grams present in the dictionary (binary search), otherwise
+    the table has 256^q entries. q = 4 has to be sparse.
+ */
+template <class t_csa = sdsl::csa_wt<sdsl::wt_huff<sdsl::bit_vector_il<64> >, 4, 4096>,
+    uint32_t t_q = 3,
+    bool t_sparse = false>
+struct dict_index_csa_qgram : public dict_index_csa<t_csa> {
+    static_assert(t_q >= 2 && t_q <= 4, "q-gram table supports q = 2..4");
+    static_assert(t_q != 4 || t_sparse, "q = 4 requires a sparse q-gram table");
+    typedef typename sdsl::int_vector<>::size_type size_type;
+    qgram_intervals qgrams;
+
+    std::string type() const
+    {
+        return "dict_index_csa_qgram-" + sdsl::util::class_to_hash(*this);
+    }
+
+    dict_index_csa_qgram(collection& col, bool rebuild)
+        : dict_index_csa<t_csa>(col, rebuild)
+    {
+        auto dict_hash = col.param_map[PARAM_DICT_HASH];
+        auto file_name = col.path + "/index/" + type() + "-dhash=" + dict_hash + ".sdsl";
+        if (!rebuild && utils::file_exists(file_name)) {
+            LOG(INFO) << "\tQ-gram table exists. Loading table from file.";
+            std::ifstream ifs(file_name);
+            qgrams.load(ifs);
+        }
+        else {
+            LOG(INFO) << "\tConstruct " << t_q << "-gram table";
+            sdsl::read_only_mapper<8> dict(col.file_map[KEY_DICT]);
+            construct_qgrams(dict);
+            LOG(INFO) << "\tWrite q-gram table to disk";
+            std::ofstream ofs(file_name);
+            qgrams.serialize(ofs);
+        }
+    }
+
+    explicit dict_index_csa_qgram(const sdsl::int_vector<8>& dict)
+        : dict_index_csa<t_csa>(dict)
+    {
+        construct_qgrams(dict);
+    }
+
+    template <class t_dict>
+    void construct_qgrams(const t_dict& dict)
+    {
+        const auto& sa = this->sa;
+        /* position r < n-1 of the reverse dictionary is dict[n-2-r], the
+           suffixes starting with a q-gram are contiguous in sa order */
+        const uint64_t n = sa.size();
+        std::vector<uint64_t> keys;
+        std::vector<uint64_t> intervals;
+        for (uint64_t i = 0; i < n; i++) {
+            uint64_t r = sa[i];
+            if (r + t_q > n - 1)
+                continue;
+            uint64_t key = 0;
+            for (uint64_t j = 0; j < t_q; j++) { // rev[r+j] = s_{q-j}
+                key |= uint64_t(dict[n - 2 - (r + j)]) << (8 * (t_q - 1 - j));
+            }
+            if (keys.empty() || keys.back() != key) {
+                keys.push_back(key);
+                intervals.push_back(i);
+                intervals.push_back(i);
+            }
+            else {
+                intervals.back() = i;
+            }
+        }
+        LOG(INFO) << "\t" << keys.size() << " distinct " << t_q << "-grams";
+        qgrams.q = t_q;
+        if (t_sparse) {
+            qgrams.keys = sdsl::int_vector<>(keys.size(), 0, 8 * t_q);
+            std::copy(keys.begin(), keys.end(), qgrams.keys.begin());
+            qgrams.intervals = sdsl::int_vector<>(intervals.size(), 0, sdsl::bits::hi(n) + 1);
+            std::copy(intervals.begin(), intervals.end(), qgrams.intervals.begin());
+        }
+        else {
+            uint64_t num_qgrams = 1ULL << (8 * t_q);
+            qgrams.keys = sdsl::int_vector<>(0);
+            qgrams.intervals = sdsl::int_vector<>(2 * num_qgrams, 0, sdsl::bits::hi(n) + 1);
+            for (uint64_t k = 0; k < num_qgrams; k++) // empty intervals
+                qgrams.intervals[2 * k] = 1;
+            for (size_t k = 0; k < keys.size(); k++) {
+                qgrams.intervals[2 * keys[k]] = intervals[2 * k];
+                qgrams.intervals[2 * keys[k] + 1] = intervals[2 * k + 1];
+            }
+        }
+    }
+
+    inline size_type serialize(std::ostream& out, sdsl::structure_tree_node* v = NULL, std::string name = "") const
+    {
+        using namespace sdsl;
+        structure_tree_node* child = structure_tree::add_child(v, name, sdsl::util::class_name(*this));
+        size_type written_bytes = 0;
+        written_bytes += dict_index_csa<t_csa>::serialize(out, child, "csa index");
+        written_bytes += qgrams.serialize(out, child, "qgrams");
+        sdsl::structure_tree::add_size(child, written_bytes);
+        return written_bytes;
+    }
+
+    template <class t_itr, bool t_search_local_block_context>
+    factor_itr_csa<t_csa, t_itr, t_search_local_block_context> factorize(t_itr itr, t_itr end, bool debug = false) const
+    {
+        return factor_itr_csa<t_csa, t_itr, t_search_local_block_context>(this->sa, itr, end, debug, &qgrams);
+    }
+};
@@ -4,6 +4,15 @@
 #include <string>
 #include <sdsl/rmq_support.hpp>
 #include "utils.hpp"
+#include "match_length.hpp"
+
+/*
+    older variant of dict_index_csa that searched the local block context
+    inside the factor iterator (local/local_offset). it is not included
+    anywhere and does not fit the current factorizor, which does the local
+    search itself (see local_block_context.hpp), so the factor selectors no
+    longer handle local factors coming from an index.
+ */
 
 template <class t_csa, class t_itr, bool t_local_search>
 struct factor_itr_csa {
@@ -101,12 +110,11 @@ struct factor_itr_csa {
                     uint32_t p = qgram_list.pos[i];
                     auto tmp = start + p + sizeof(uint64_t); // we now the qgram matches!
                     auto pitr = factor_start + sizeof(uint64_t);
-                    size_t match_len = sizeof(uint64_t);
-                    while(tmp != factor_start && pitr != end && *tmp == *pitr) {
-                        match_len++;
-                        ++tmp;
-                        ++pitr;
-                    }
+                    auto before_factor = std::distance(tmp, factor_start);
+                    if (before_factor < 0) // p + 8 is already past the start of the factor
+                        before_factor = 0;
+                    uint64_t max_len = std::min(before_factor, std::distance(pitr, end));
+                    size_t match_len = sizeof(uint64_t) + match_length(tmp, pitr, max_len);
                     if(match_len > max_match_len) {
                         local_offset = p;
                         max_match_len = match_len;
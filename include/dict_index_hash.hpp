@@ -0,0 +1,259 @@
+#pragma once
+
+#include "utils.hpp"
+#include "collection.hpp"
+#include "match_length.hpp"
+
+#include <sdsl/int_vector.hpp>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+template <class t_index, bool t_local_search>
+struct factor_itr_hash {
+    const t_index& idx;
+    std::vector<uint8_t> block; // copy of the block so matches are compared in contiguous memory
+    size_t pos;
+    uint64_t sp;
+    uint64_t ep;
+    uint64_t len;
+    bool done;
+
+    template <class t_itr>
+    factor_itr_hash(const t_index& _idx, t_itr begin, t_itr end)
+        : idx(_idx)
+        , block(begin, end)
+        , pos(0)
+        , sp(0)
+        , ep(0)
+        , len(0)
+        , done(false)
+    {
+        find_next_factor();
+    }
+    factor_itr_hash& operator++()
+    {
+        find_next_factor();
+        return *this;
+    }
+
+    /* continue the factorization at position block_pos of the block */
+    void restart_at(size_t block_pos)
+    {
+        pos = block_pos;
+        find_next_factor();
+    }
+
+    inline void find_next_factor()
+    {
+        if (pos == block.size()) {
+            done = true;
+            return;
+        }
+        const uint8_t* pat = block.data() + pos;
+        uint64_t left = block.size() - pos;
+        auto m = idx.longest_match(pat, left);
+        sp = ep = m.first;
+        len = m.second;
+        if (len == 0) { // unknown symbol factor found
+            pos++;
+        }
+        else {
+            pos += len;
+        }
+    }
+    inline bool finished() const
+    {
+        return done;
+    }
+};
+
+/*
+    dictionary index for fast factorization which trades space for speed.
+    all dictionary positions are chained by the hash of the 4-gram starting
+    there (as in the zlib/LZ4 match finders) and the candidates are verified
+    and extended with match_length. matches shorter than 4 bytes are found
+    through tables of the first occurrence of every 1-, 2- and 3-gram.
+
+    by default at most t_max_chain = 128 candidates (the most recent
+    positions with the hash) are checked per factor. the index is then
+    approximate: a factor may be shorter than the longest match, but frequent
+    4-grams such as "the " or "<div", which occur millions of times in a large
+    dictionary, no longer make each factor cost O(occurrences). with
+    t_max_chain = 0 all candidates are checked and the factors are the same
+    maximal greedy factors the suffix array indexes produce (the occurrence
+    picked may differ). bench-dict-indexes.x compares the speed and factor
+    lengths against dict_index_sa and dict_index_csa.
+
+    there is no suffix array, so the iterator reports the matched dictionary
+    position as the interval [sp,sp] and sa is the identity on dictionary
+    positions, which keeps the factor selectors working unchanged.
+ */
+template <uint32_t t_hash_bits = 22, uint32_t t_max_chain = 128>
+struct dict_index_hash {
+    typedef typename sdsl::int_vector<>::size_type size_type;
+
+    struct identity_sa {
+        uint64_t n = 0;
+        uint64_t operator[](uint64_t i) const { return i; }
+        uint64_t size() const { return n; }
+    };
+
+    identity_sa sa;
+    sdsl::int_vector<8> text;
+    sdsl::int_vector<32> head; // 1 + last position with the hash, 0 if none
+    sdsl::int_vector<32> prev; // 1 + previous position with the same hash, 0 if none
+    sdsl::int_vector<32> first1; // 1 + first position of each 1-gram, 0 if none
+    sdsl::int_vector<32> first2;
+    sdsl::int_vector<32> first3;
+
+    static std::string type()
+    {
+        return "dict_index_hash-h=" + std::to_string(t_hash_bits) + "-c=" + std::to_string(t_max_chain);
+    }
+
+    dict_index_hash(collection& col, bool rebuild)
+    {
+        auto dict_hash = col.param_map[PARAM_DICT_HASH];
+        auto file_name = col.path + "/index/" + type() + "-dhash=" + dict_hash + ".sdsl";
+        if (!rebuild && utils::file_exists(file_name)) {
+            LOG(INFO) << "\tDictionary index exists. Loading index from file.";
+            std::ifstream ifs(file_name);
+            load(ifs);
+        }
+        else {
+            LOG(INFO) << "\tConstruct and store dictionary index";
+            sdsl::load_from_file(text, col.file_map[KEY_DICT]);
+            build();
+            LOG(INFO) << "\tWrite index to disk";
+            std::ofstream ofs(file_name);
+            serialize(ofs);
+        }
+    }
+
+    explicit dict_index_hash(const sdsl::int_vector<8>& dict)
+        : text(dict)
+    {
+        build();
+    }
+
+    static inline uint32_t load_qgram(const uint8_t* ptr, size_t q)
+    {
+        uint32_t x = 0;
+        for (size_t i = 0; i < q; i++)
+            x = (x << 8) | ptr[i];
+        return x;
+    }
+
+    static inline uint32_t hash4(const uint8_t* ptr)
+    {
+        uint32_t x;
+        std::memcpy(&x, ptr, 4);
+        return (x * 2654435761U) >> (32 - t_hash_bits);
+    }
+
+    void build()
+    {
+        sa.n = text.size();
+        const uint8_t* dict = (const uint8_t*)text.data();
+        size_t n = text.size();
+        LOG(INFO) << "\tHash the 4-grams of the dictionary";
+        head = sdsl::int_vector<32>(1ULL << t_hash_bits, 0);
+        prev = sdsl::int_vector<32>(n, 0);
+        for (size_t i = 0; i + 4 <= n; i++) {
+            auto h = hash4(dict + i);
+            prev[i] = head[h];
+            head[h] = i + 1;
+        }
+        LOG(INFO) << "\tStore the first occurrence of all 1-, 2- and 3-grams";
+        first1 = sdsl::int_vector<32>(1ULL << 8, 0);
+        first2 = sdsl::int_vector<32>(1ULL << 16, 0);
+        first3 = sdsl::int_vector<32>(1ULL << 24, 0);
+        sdsl::int_vector<32>* first[3] = { &first1, &first2, &first3 };
+        for (size_t q = 1; q <= 3; q++) {
+            auto& f = *first[q - 1];
+            for (size_t i = n; i >= q; i--) { // backwards so the first occurrence is kept
+                f[load_qgram(dict + i - q, q)] = i - q + 1;
+            }
+        }
+    }
+
+    /* (position,length) of the longest match of pat[0..left) in the dictionary */
+    std::pair<uint64_t, uint64_t> longest_match(const uint8_t* pat, uint64_t left) const
+    {
+        const uint8_t* dict = (const uint8_t*)text.data();
+        const uint64_t n = text.size();
+        uint64_t best_pos = 0;
+        uint64_t best_len = 0;
+        if (left >= 4) {
+            uint64_t cand = head[hash4(pat)];
+            uint64_t steps = 0;
+            while (cand != 0 && (t_max_chain == 0 || steps < t_max_chain)) {
+                uint64_t p = cand - 1;
+                auto l = match_length(dict + p, pat, std::min(left, n - p));
+                if (l > best_len) {
+                    best_len = l;
+                    best_pos = p;
+                    if (best_len == left)
+                        break;
+                }
+                cand = prev[p];
+                steps++;
+            }
+        }
+        if (best_len < 4) {
+            const sdsl::int_vector<32>* first[3] = { &first1, &first2, &first3 };
+            for (size_t q = std::min(left, (uint64_t)3); q > best_len; q--) {
+                uint64_t p1 = (*first[q - 1])[load_qgram(pat, q)];
+                if (p1 != 0) {
+                    uint64_t p = p1 - 1;
+                    auto l = match_length(dict + p, pat, std::min(left, n - p));
+                    if (l > best_len) {
+                        best_len = l;
+                        best_pos = p;
+                    }
+                    break;
+                }
+            }
+        }
+        return { best_pos, best_len };
+    }
+
+    inline size_type serialize(std::ostream& out, sdsl::structure_tree_node* v = NULL, std::string name = "") const
+    {
+        using namespace sdsl;
+        structure_tree_node* child = structure_tree::add_child(v, name, sdsl::util::class_name(*this));
+        size_type written_bytes = 0;
+        written_bytes += text.serialize(out, child, "text");
+        written_bytes += head.serialize(out, child, "head");
+        written_bytes += prev.serialize(out, child, "prev");
+        written_bytes += first1.serialize(out, child, "first1");
+        written_bytes += first2.serialize(out, child, "first2");
+        written_bytes += first3.serialize(out, child, "first3");
+        sdsl::structure_tree::add_size(child, written_bytes);
+        return written_bytes;
+    }
+
+    inline void load(std::istream& in)
+    {
+        text.load(in);
+        head.load(in);
+        prev.load(in);
+        first1.load(in);
+        first2.load(in);
+        first3.load(in);
+        sa.n = text.size();
+    }
+
+    template <class t_itr, bool t_search_local_block_context>
+    factor_itr_hash<dict_index_hash, t_search_local_block_context> factorize(t_itr itr, t_itr end) const
+    {
+        return factor_itr_hash<dict_index_hash, t_search_local_block_context>(*this, itr, end);
+    }
+
+    bool is_reverse() const
+    {
+        return false;
+    }
+};
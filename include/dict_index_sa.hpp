@@ -1,14 +1,28 @@
 #pragma once
 
+#include "match_length.hpp"
+
 #include <sdsl/int_vector.hpp>
+#include <algorithm>
 #include <string>
 #include <sdsl/rmq_support.hpp>
 
-template <class t_itr, bool t_local_search>
+typedef sdsl::rmq_succinct_sct<true> lcp_rmq_type;
+
+/*
+    if t_lcp_skip is set, lcp/lcp_rmq hold the LCP array of the dictionary
+    and a range minimum structure over it. all suffixes in [sp,ep] share
+    the interval LCP of min(lcp[sp+1..ep]) symbols, so the search compares
+    these symbols against a single suffix instead of refining the interval
+    one symbol at a time.
+ */
+template <class t_itr, bool t_local_search, bool t_lcp_skip = false>
 struct factor_itr_sa {
     const sdsl::int_vector<>& sa;
     const sdsl::int_vector<8>& text;
     const sdsl::int_vector<>& cache;
+    const sdsl::int_vector<>* lcp;
+    const lcp_rmq_type* lcp_rmq;
     decltype(sa.begin()) sa_start;
     decltype(text.begin()) text_start;
     t_itr factor_start;
@@ -19,16 +33,16 @@ struct factor_itr_sa {
     uint64_t sp;
     uint64_t ep;
     uint64_t len;
-    uint64_t local_offset;
     uint8_t sym;
     bool done;
-    bool local;
 
-    // std::unordered_map<uint32_t,std::vector<uint32_t>> qgrams;
-    factor_itr_sa(const sdsl::int_vector<>& _sa, const sdsl::int_vector<8>& _text, const sdsl::int_vector<>& _cache, t_itr begin, t_itr _end)
+    factor_itr_sa(const sdsl::int_vector<>& _sa, const sdsl::int_vector<8>& _text, const sdsl::int_vector<>& _cache, t_itr begin, t_itr _end,
+        const sdsl::int_vector<>* _lcp = nullptr, const lcp_rmq_type* _lcp_rmq = nullptr)
         : sa(_sa)
         , text(_text)
         , cache(_cache)
+        , lcp(_lcp)
+        , lcp_rmq(_lcp_rmq)
         , sa_start(sa.begin())
         , text_start(text.begin())
         , factor_start(begin)
@@ -38,13 +52,10 @@ struct factor_itr_sa {
         , sp(0)
         , ep(_sa.size() - 1)
         , len(0)
-        , local_offset(0)
         , sym(0)
         , done(false)
-        , local(false)
     {
         find_next_factor();
-        //qgrams.reserve(64000);
     }
     factor_itr_sa& operator++()
     {
@@ -52,68 +63,13 @@ struct factor_itr_sa {
         return *this;
     }
 
-    inline void find_longer_local_factor()
+    /* continue the factorization at position block_pos of the block, e.g.
+       after the factorizor used a local factor instead of the current one */
+    void restart_at(size_t block_pos)
     {
-        local = false;
-        // (1) local search enabled?
-        if (!t_local_search)
-            return;
-        // (2) is the global factor already quite long? are we in the first part of the block?
-        // if( std::distance(start,itr) > 1024 && len >= 20) return;
-
-        // // (3) search for a better factor locally
-        // {
-        //     utils::rlz_timer<std::chrono::nanoseconds> fbt("search q-gram");
-        //     uint32_t qgram = 0; uint8_t* qg8 = (uint8_t*) &qgram;
-        //     qg8[0] = *factor_start; qg8[1] = *(factor_start+1); qg8[2] = *(factor_start+2);  qg8[3] = *(factor_start+3);
-        //     auto qitr = qgrams.find(qgram);
-        //     if( qitr != qgrams.end()) { // found the qgram at the start of the current factor?
-        //         const auto& qpos = qitr->second;
-        //         bool found = false;
-        //         size_t max_match_len = 0;
-        //         local_offset = 0;
-        //         for(const auto& p : qpos) { // check all pos of qgram for better matches
-        //             auto tmp = start + p;
-        //             auto pitr = factor_start;
-        //             size_t match_len = 0;
-        //             while(tmp != factor_start && pitr != end && *tmp == *pitr) {
-        //                 match_len++;
-        //                 ++tmp;
-        //                 ++pitr;
-        //             }
-        //             if(match_len > max_match_len) {
-        //                 local_offset = p;
-        //                 max_match_len = match_len;
-        //                 found = true;
-        //             }
-        //         }
-        //         if(found && max_match_len > len) {
-        //             local = true;
-        //             len = max_match_len;
-        //             itr = factor_start + len;
-        //         }
-        //     }
-        // }
-        // // (4) update the local q-gram index
-        // {
-        //     utils::rlz_timer<std::chrono::nanoseconds> fbt("update q-gram");
-        //     uint32_t qgram = 0; uint8_t* qg8 = (uint8_t*) &qgram;
-        //     auto tmp = factor_start;
-        //     size_t syms_seen = 0;
-        //     while(tmp != itr) {
-        //         qg8[syms_seen] = *tmp;
-        //         syms_seen++;
-        //         if(syms_seen == 4) {
-        //             auto offset = std::distance(start,tmp) - 3;
-        //             qgrams[qgram].push_back(offset);
-        //             qg8[0] = qg8[1];
-        //             qg8[1] = qg8[2];
-        //             qg8[2] = qg8[3];
-        //             syms_seen = 3;
-        //         }
-        //         ++tmp;
-        //     }
-        // }
+        itr = start + block_pos;
+        factor_start = itr;
+        find_next_factor();
     }
 
     bool refine_bounds(uint64_t& lb, uint64_t& rb, uint8_t pat_sym, size_t offset)
@@ -162,6 +118,36 @@ struct factor_itr_sa {
         return false;
     }
 
+    /* longest common prefix of all suffixes in [sp,ep]. without the LCP
+       array it is the common prefix of the first and the last suffix */
+    inline uint64_t interval_lcp() const
+    {
+        if (sp == ep)
+            return sa.size() - sa[sp];
+        if (t_lcp_skip)
+            return (*lcp)[(*lcp_rmq)(sp + 1, ep)];
+        uint64_t first = sa[sp];
+        uint64_t last = sa[ep];
+        const uint8_t* dict = (const uint8_t*)text.data();
+        return match_length(dict + first, dict + last, sa.size() - std::max(first, last));
+    }
+
+    /* match the symbols shared by all suffixes in [sp,ep]. returns false on
+       a mismatch, in which case no suffix matches a longer prefix */
+    inline bool skip_interval_lcp(size_t& offset)
+    {
+        auto lcp_len = interval_lcp();
+        auto text_itr = text_start + sa[sp] + offset;
+        while (offset < lcp_len && itr != end) {
+            if (*text_itr != *itr)
+                return false;
+            ++itr;
+            ++text_itr;
+            ++offset;
+        }
+        return true;
+    }
+
     inline void find_next_factor()
     {
         if (itr == end) {
@@ -192,19 +178,24 @@ struct factor_itr_sa {
         }
 
         /* refine bounds as long as possible */
-        while (itr != end && refine_bounds(sp, ep, *itr, offset)) {
+        bool mismatch = false;
+        if (t_lcp_skip && sp < ep)
+            mismatch = !skip_interval_lcp(offset);
+        while (!mismatch && itr != end && refine_bounds(sp, ep, *itr, offset)) {
             ++itr;
             ++offset;
             if (sp == ep)
                 break;
+            if (t_lcp_skip)
+                mismatch = !skip_interval_lcp(offset);
         }
         if (sp == ep) {
-            auto text_itr = text_start + sa[sp] + offset;
-            while (itr != end && *text_itr == *itr) {
-                ++itr;
-                ++text_itr;
-                ++offset;
-            }
+            // a single suffix is left, extend the match as far as possible
+            const uint8_t* dict_ptr = (const uint8_t*)text.data() + sa[sp] + offset;
+            uint64_t max_len = std::min((uint64_t)std::distance(itr, end), (uint64_t)(text.size() - (sa[sp] + offset)));
+            auto match_len = match_length(dict_ptr, itr, max_len);
+            itr += match_len;
+            offset += match_len;
         }
 
         len = offset;
@@ -241,48 +232,59 @@ struct dict_index_sa {
         }
         else {
             LOG(INFO) << "\tConstruct and store dictionary index";
-            LOG(INFO) << "\tConstruct suffix array";
             sdsl::load_from_file(text, col.file_map[KEY_DICT]);
-            sa.width(sdsl::bits::hi(text.size()) + 1);
-            sdsl::algorithm::calculate_sa((const uint8_t*)text.data(), text.size(), sa);
-
-            //
-            LOG(INFO) << "\tCompute a 3-gram cache";
-            {
-                size_t num_kgrams = 256 * 256 * 256;
-                sdsl::int_vector<> counts(num_kgrams);
-                uint32_t cur_k_gram = uint32_t(text[0]) << 16 | uint32_t(text[1]) << 8 | uint32_t(text[2]);
-                counts[cur_k_gram]++;
-                for (size_t i = 3; i < text.size(); i++) {
-                    cur_k_gram = ((cur_k_gram << 8) & 0xFFFF00) | uint32_t(text[i]);
-                    counts[cur_k_gram]++;
-                }
+            build();
+            LOG(INFO) << "\tWrite index to disk";
+            std::ofstream ofs(file_name);
+            serialize(ofs);
+        }
+    }
+
+    explicit dict_index_sa(const sdsl::int_vector<8>& dict)
+        : text(dict)
+    {
+        build();
+    }
+
+    void build()
+    {
+        LOG(INFO) << "\tConstruct suffix array";
+        sa.width(sdsl::bits::hi(text.size()) + 1);
+        sdsl::algorithm::calculate_sa((const uint8_t*)text.data(), text.size(), sa);
 
-                /* fix up some counts at the end */
-                counts[0] = 1;
-                cur_k_gram = uint32_t(text[text.size() - 2]) << 16 | uint32_t(text[text.size() - 1]) << 8 | uint32_t(text[text.size() - 1]);
+        //
+        LOG(INFO) << "\tCompute a 3-gram cache";
+        {
+            size_t num_kgrams = 256 * 256 * 256;
+            sdsl::int_vector<> counts(num_kgrams);
+            uint32_t cur_k_gram = uint32_t(text[0]) << 16 | uint32_t(text[1]) << 8 | uint32_t(text[2]);
+            counts[cur_k_gram]++;
+            for (size_t i = 3; i < text.size(); i++) {
+                cur_k_gram = ((cur_k_gram << 8) & 0xFFFF00) | uint32_t(text[i]);
                 counts[cur_k_gram]++;
+            }
+
+            /* fix up some counts at the end */
+            counts[0] = 1;
+            cur_k_gram = uint32_t(text[text.size() - 2]) << 16 | uint32_t(text[text.size() - 1]) << 8 | uint32_t(text[text.size() - 1]);
+            counts[cur_k_gram]++;
 
-                sdsl::int_vector<> ccounts(num_kgrams);
-                ccounts[0] = 0;
+            sdsl::int_vector<> ccounts(num_kgrams);
+            ccounts[0] = 0;
 
-                for (size_t i = 1; i < num_kgrams; i++)
-                    ccounts[i] = ccounts[i - 1] + counts[i - 1];
+            for (size_t i = 1; i < num_kgrams; i++)
+                ccounts[i] = ccounts[i - 1] + counts[i - 1];
 
-                cache.resize(num_kgrams * 2);
-                for (size_t i = 0; i < num_kgrams; i++) {
-                    cache[i * 2] = ccounts[i];
-                    cache[i * 2 + 1] = ccounts[i] + counts[i] - 1;
-                    if (counts[i] == 0) {
-                        cache[i * 2] += 2;
-                        cache[i * 2 + 1] += 1;
-                    }
+            cache.resize(num_kgrams * 2);
+            for (size_t i = 0; i < num_kgrams; i++) {
+                cache[i * 2] = ccounts[i];
+                cache[i * 2 + 1] = ccounts[i] + counts[i] - 1;
+                if (counts[i] == 0) {
+                    cache[i * 2] += 2;
+                    cache[i * 2 + 1] += 1;
                 }
-                sdsl::util::bit_compress(cache);
             }
-            LOG(INFO) << "\tWrite index to disk";
-            std::ofstream ofs(file_name);
-            serialize(ofs);
+            sdsl::util::bit_compress(cache);
         }
     }
 
@@ -316,3 +318,92 @@ struct dict_index_sa {
         return false;
     }
 };
+
+/*
+    dict_index_sa plus the LCP array of the dictionary and a range minimum
+    structure over it. the factors are the same as with dict_index_sa, but
+    the search for long factors jumps over the symbols shared by the
+    current suffix array interval.
+ */
+struct dict_index_sa_lcp : public dict_index_sa {
+    sdsl::int_vector<> lcp;
+    lcp_rmq_type lcp_rmq;
+
+    std::string type() const
+    {
+        return "dict_index_sa_lcp-" + sdsl::util::class_to_hash(*this);
+    }
+
+    dict_index_sa_lcp(collection& col, bool rebuild)
+        : dict_index_sa(col, rebuild)
+    {
+        auto dict_hash = col.param_map[PARAM_DICT_HASH];
+        auto file_name = col.path + "/index/" + type() + "-dhash=" + dict_hash + ".sdsl";
+        if (!rebuild && utils::file_exists(file_name)) {
+            LOG(INFO) << "\tLCP index exists. Loading index from file.";
+            std::ifstream ifs(file_name);
+            lcp.load(ifs);
+            lcp_rmq.load(ifs);
+        }
+        else {
+            LOG(INFO) << "\tConstruct LCP array";
+            construct_lcp();
+            LOG(INFO) << "\tConstruct LCP RMQ";
+            lcp_rmq = lcp_rmq_type(&lcp);
+            LOG(INFO) << "\tWrite index to disk";
+            std::ofstream ofs(file_name);
+            lcp.serialize(ofs);
+            lcp_rmq.serialize(ofs);
+        }
+    }
+
+    explicit dict_index_sa_lcp(const sdsl::int_vector<8>& dict)
+        : dict_index_sa(dict)
+    {
+        construct_lcp();
+        lcp_rmq = lcp_rmq_type(&lcp);
+    }
+
+    /* kasai et al. lcp[i] = lcp of the suffixes sa[i-1] and sa[i], lcp[0] = 0 */
+    void construct_lcp()
+    {
+        size_t n = sa.size();
+        sdsl::int_vector<> isa(n, 0, sdsl::bits::hi(n) + 1);
+        for (size_t i = 0; i < n; i++)
+            isa[sa[i]] = i;
+        lcp = sdsl::int_vector<>(n, 0, sdsl::bits::hi(n) + 1);
+        uint64_t l = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t r = isa[i];
+            if (r == 0) {
+                l = 0;
+                continue;
+            }
+            uint64_t j = sa[r - 1];
+            while (i + l < n && j + l < n && text[i + l] == text[j + l])
+                l++;
+            lcp[r] = l;
+            if (l > 0)
+                l--;
+        }
+        sdsl::util::bit_compress(lcp);
+    }
+
+    inline size_type serialize(std::ostream& out, sdsl::structure_tree_node* v = NULL, std::string name = "") const
+    {
+        using namespace sdsl;
+        structure_tree_node* child = structure_tree::add_child(v, name, sdsl::util::class_name(*this));
+        size_type written_bytes = 0;
+        written_bytes += dict_index_sa::serialize(out, child, "sa index");
+        written_bytes += lcp.serialize(out, child, "lcp");
+        written_bytes += lcp_rmq.serialize(out, child, "lcp rmq");
+        sdsl::structure_tree::add_size(child, written_bytes);
+        return written_bytes;
+    }
+
+    template <class t_itr, bool t_search_local_block_context>
+    factor_itr_sa<t_itr, t_search_local_block_context, true> factorize(t_itr itr, t_itr end) const
+    {
+        return factor_itr_sa<t_itr, t_search_local_block_context, true>(sa, text, cache, itr, end, &lcp, &lcp_rmq);
+    }
+};
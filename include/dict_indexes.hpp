@@ -1,4 +1,5 @@
 #pragma once
 
 #include "dict_index_csa.hpp"
-#include "dict_index_sa.hpp"
\ No newline at end of file
+#include "dict_index_sa.hpp"
+#include "dict_index_hash.hpp"
@@ -50,7 +50,7 @@ struct dict_prune_rem {
         auto dict_stats_file = dict_file + "-" + KEY_DICT_STATISTICS + "-" + t_factorization_strategy::type() + ".sdsl";
         factorization_statistics fstats;
         if (rebuild || !utils::file_exists(dict_stats_file)) {
-            fstats = t_factorization_strategy::template parallel_factorize<factor_tracker>(col, rebuild, num_threads);
+            fstats = t_factorization_strategy::template parallel_factorize<factor_tracker<t_factorization_strategy::search_local_block_context> >(col, rebuild, num_threads);
             sdsl::store_to_file(fstats, dict_stats_file);
         }
         else {
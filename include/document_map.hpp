@@ -0,0 +1,348 @@
+#pragma once
+
+#include "collection.hpp"
+
+#include <sdsl/int_vector.hpp>
+#include <sdsl/sd_vector.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+/*
+    maps documents to text ranges. built from the DOCORDER file written by
+    create-collection which lists "docno position" per document in text order,
+    where position is the offset of the <DOCNO> tag. the start of a document is
+    the <DOC> tag preceding its <DOCNO> (see read_document_order), so document
+    i spans the whole record [start(i),start(i+1)); the last one extends to the
+    end of the text. the starts are stored as an Elias-Fano coded (sd_vector) bitvector,
+    the docnos as concatenated strings plus the doc ids in docno order so both
+    directions can be resolved.
+ */
+class document_map {
+public:
+    typedef typename sdsl::int_vector<>::size_type size_type;
+
+private:
+    sdsl::sd_vector<> m_doc_starts;
+    sdsl::sd_vector<>::select_1_type m_doc_starts_select;
+    sdsl::sd_vector<>::rank_1_type m_doc_starts_rank;
+    sdsl::int_vector<8> m_docnos;
+    sdsl::int_vector<> m_docno_starts;
+    sdsl::int_vector<> m_docno_order;
+    uint64_t m_num_docs = 0;
+    uint64_t m_text_size = 0;
+
+public:
+    static std::string type()
+    {
+        return "document_map_v2"; // v2 starts documents at <DOC> instead of <DOCNO>
+    }
+
+    static std::string file_name(collection& col)
+    {
+        return col.path + "/index/" + KEY_DOCMAP + "-" + type() + ".sdsl";
+    }
+
+    static std::string docorder_file_name(collection& col)
+    {
+        return col.path + "/" + KEY_PREFIX + KEY_DOCORDER;
+    }
+
+    /* build the map if the collection has a DOCORDER file and register it in the file map */
+    static void create(collection& col, bool rebuild)
+    {
+        if (!utils::file_exists(docorder_file_name(col))) {
+            LOG(INFO) << "No document order file found. Skipping document map.";
+            return;
+        }
+        auto docmap_file = file_name(col);
+        if (rebuild || !utils::file_exists(docmap_file)) {
+            LOG(INFO) << "Create document map (" << type() << ")";
+            document_map tmp(col);
+            sdsl::store_to_file(tmp, docmap_file);
+        }
+        col.file_map[KEY_DOCMAP] = docmap_file;
+    }
+
+    /*
+        read the DOCORDER file into document starts and docnos. create-collection
+        records the offset of each <DOCNO> tag, so each start is moved back to
+        the last <DOC> tag between the previous <DOCNO> and this one (if any).
+        the positions have to increase, the unsigned arithmetic on the starts
+        relies on it.
+     */
+    static void read_document_order(collection& col, std::vector<uint64_t>& starts, std::vector<std::string>& docnos)
+    {
+        std::ifstream dof(docorder_file_name(col));
+        if (!dof.is_open()) {
+            throw std::runtime_error("Cannot open document order file.");
+        }
+        const sdsl::int_vector_mapper<8, std::ios_base::in> text(col.file_map[KEY_TEXT]);
+        const uint8_t* text_begin = (const uint8_t*)text.data();
+        const std::string doc_tag("<DOC>");
+        starts.clear();
+        docnos.clear();
+        std::string docno;
+        uint64_t pos;
+        uint64_t prev_pos = 0;
+        while (dof >> docno >> pos) {
+            if (!docnos.empty() && pos <= prev_pos) {
+                throw std::runtime_error("Document order file is not sorted by text position.");
+            }
+            uint64_t start = pos;
+            if (pos <= text.size()) {
+                auto tag = std::find_end(text_begin + prev_pos, text_begin + pos, doc_tag.begin(), doc_tag.end());
+                if (tag != text_begin + pos)
+                    start = std::distance(text_begin, tag);
+            }
+            prev_pos = pos;
+            starts.push_back(start);
+            docnos.push_back(docno);
+        }
+    }
+
+    static std::string block_starts_file_name(collection& col, uint64_t block_size)
+    {
+        return col.path + "/index/" + KEY_BLOCKSTARTS + "-docaligned_v2-" + std::to_string(block_size) + ".sdsl";
+    }
+
+    /*
+        text start positions of document aligned blocks. whole documents are packed
+        into a block as long as it stays within block_size bytes. documents larger than
+        block_size are split into block_size sized pieces and the last piece starts a
+        new block which following documents can join.
+     */
+    static std::vector<uint64_t> document_aligned_block_starts(collection& col, uint64_t block_size)
+    {
+        uint64_t text_size = 0;
+        {
+            const sdsl::int_vector_mapper<8, std::ios_base::in> text(col.file_map[KEY_TEXT]);
+            text_size = text.size();
+        }
+        std::vector<uint64_t> doc_starts;
+        std::vector<std::string> docnos;
+        read_document_order(col, doc_starts, docnos);
+        std::vector<uint64_t> doc_bounds;
+        for (const auto& pos : doc_starts) {
+            if (pos != 0 && pos < text_size)
+                doc_bounds.push_back(pos);
+        }
+        doc_bounds.push_back(text_size);
+
+        std::vector<uint64_t> starts;
+        if (text_size == 0)
+            return starts;
+        starts.push_back(0);
+        uint64_t cur_start = 0;
+        uint64_t doc_start = 0;
+        for (const auto& doc_end : doc_bounds) {
+            if (doc_end - cur_start > block_size) {
+                if (doc_start > cur_start) {
+                    cur_start = doc_start;
+                    starts.push_back(cur_start);
+                }
+                while (doc_end - cur_start > block_size) {
+                    cur_start += block_size;
+                    starts.push_back(cur_start);
+                }
+            }
+            doc_start = doc_end;
+        }
+        return starts;
+    }
+
+    /*
+        compute the document aligned block starts if necessary and switch the
+        collection to document aligned blocking.
+     */
+    static void create_aligned_block_starts(collection& col, uint64_t block_size, bool rebuild)
+    {
+        auto starts_file = block_starts_file_name(col, block_size);
+        if (rebuild || !utils::file_exists(starts_file)) {
+            LOG(INFO) << "Create document aligned blocks (max block size = " << block_size << ")";
+            auto starts = document_aligned_block_starts(col, block_size);
+            sdsl::int_vector<> block_starts(starts.size());
+            for (size_t i = 0; i < starts.size(); i++)
+                block_starts[i] = starts[i];
+            sdsl::util::bit_compress(block_starts);
+            sdsl::store_to_file(block_starts, starts_file);
+            LOG(INFO) << "\tNumber of blocks = " << starts.size();
+        }
+        register_aligned_block_starts(col, block_size);
+    }
+
+    static void register_aligned_block_starts(collection& col, uint64_t block_size)
+    {
+        auto starts_file = block_starts_file_name(col, block_size);
+        if (!utils::file_exists(starts_file)) {
+            throw std::runtime_error("LOAD FAILED: Cannot find document aligned block starts.");
+        }
+        col.file_map[KEY_BLOCKSTARTS] = starts_file;
+        col.param_map[PARAM_BLOCKING] = "docaligned_v2";
+    }
+
+    document_map() = default;
+    document_map(document_map&& dm)
+    {
+        *this = std::move(dm);
+    }
+    document_map& operator=(document_map&& dm)
+    {
+        if (this != &dm) {
+            m_doc_starts = std::move(dm.m_doc_starts);
+            m_doc_starts_select = std::move(dm.m_doc_starts_select);
+            m_doc_starts_select.set_vector(&m_doc_starts);
+            m_doc_starts_rank = std::move(dm.m_doc_starts_rank);
+            m_doc_starts_rank.set_vector(&m_doc_starts);
+            m_docnos = std::move(dm.m_docnos);
+            m_docno_starts = std::move(dm.m_docno_starts);
+            m_docno_order = std::move(dm.m_docno_order);
+            m_num_docs = dm.m_num_docs;
+            m_text_size = dm.m_text_size;
+        }
+        return *this;
+    }
+
+    document_map(collection& col)
+    {
+        LOG(INFO) << "\tLoad document order from file";
+        {
+            const sdsl::int_vector_mapper<8, std::ios_base::in> text(col.file_map[KEY_TEXT]);
+            m_text_size = text.size();
+        }
+        std::vector<uint64_t> starts;
+        std::vector<std::string> docnos;
+        read_document_order(col, starts, docnos);
+        LOG(INFO) << "\tFound " << starts.size() << " documents";
+        *this = document_map(starts, docnos, m_text_size);
+    }
+
+    /* documents starting at the (increasing) text positions starts */
+    document_map(const std::vector<uint64_t>& starts, const std::vector<std::string>& docnos, uint64_t text_size)
+        : m_num_docs(starts.size())
+        , m_text_size(text_size)
+    {
+        m_doc_starts = sdsl::sd_vector<>(starts.begin(), starts.end());
+        sdsl::util::init_support(m_doc_starts_select, &m_doc_starts);
+        sdsl::util::init_support(m_doc_starts_rank, &m_doc_starts);
+
+        size_t docno_bytes = 0;
+        for (const auto& d : docnos)
+            docno_bytes += d.size();
+        m_docnos = sdsl::int_vector<8>(docno_bytes);
+        m_docno_starts = sdsl::int_vector<>(m_num_docs + 1);
+        size_t cur = 0;
+        for (size_t i = 0; i < m_num_docs; i++) {
+            m_docno_starts[i] = cur;
+            for (const auto& c : docnos[i])
+                m_docnos[cur++] = c;
+        }
+        m_docno_starts[m_num_docs] = cur;
+        sdsl::util::bit_compress(m_docno_starts);
+
+        std::vector<uint64_t> order(m_num_docs);
+        for (size_t i = 0; i < m_num_docs; i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [&docnos](uint64_t a, uint64_t b) {
+            return docnos[a] < docnos[b];
+        });
+        m_docno_order = sdsl::int_vector<>(m_num_docs);
+        for (size_t i = 0; i < m_num_docs; i++)
+            m_docno_order[i] = order[i];
+        sdsl::util::bit_compress(m_docno_order);
+    }
+
+    inline size_type serialize(std::ostream& out, sdsl::structure_tree_node* v = NULL, std::string name = "") const
+    {
+        using namespace sdsl;
+        structure_tree_node* child = structure_tree::add_child(v, name, sdsl::util::class_name(*this));
+        size_type written_bytes = 0;
+        written_bytes += m_doc_starts.serialize(out, child, "doc_starts");
+        written_bytes += m_doc_starts_select.serialize(out, child, "doc_starts_select");
+        written_bytes += m_doc_starts_rank.serialize(out, child, "doc_starts_rank");
+        written_bytes += m_docnos.serialize(out, child, "docnos");
+        written_bytes += m_docno_starts.serialize(out, child, "docno_starts");
+        written_bytes += m_docno_order.serialize(out, child, "docno_order");
+        written_bytes += sdsl::write_member(m_num_docs, out, child, "num_docs");
+        written_bytes += sdsl::write_member(m_text_size, out, child, "text_size");
+        sdsl::structure_tree::add_size(child, written_bytes);
+        return written_bytes;
+    }
+
+    inline void load(std::istream& in)
+    {
+        m_doc_starts.load(in);
+        m_doc_starts_select.load(in, &m_doc_starts);
+        m_doc_starts_rank.load(in, &m_doc_starts);
+        m_docnos.load(in);
+        m_docno_starts.load(in);
+        m_docno_order.load(in);
+        sdsl::read_member(m_num_docs, in);
+        sdsl::read_member(m_text_size, in);
+    }
+
+    size_type size_in_bytes() const
+    {
+        return sdsl::size_in_bytes(*this);
+    }
+
+    inline size_type num_docs() const
+    {
+        return m_num_docs;
+    }
+
+    /* text range [begin,end) of the document */
+    inline std::pair<uint64_t, uint64_t> document_range(uint64_t doc_id) const
+    {
+        check_doc_id(doc_id);
+        uint64_t begin = m_doc_starts_select(doc_id + 1);
+        uint64_t end = m_text_size;
+        if (doc_id + 1 < m_num_docs)
+            end = m_doc_starts_select(doc_id + 2);
+        return { begin, end };
+    }
+
+    /* document containing the text position. positions before the first document map to 0 */
+    inline uint64_t document_at(uint64_t text_pos) const
+    {
+        if (m_num_docs == 0) {
+            throw std::runtime_error("The store has no document map.");
+        }
+        auto docs_started = m_doc_starts_rank(std::min(text_pos + 1, (uint64_t)m_doc_starts.size()));
+        return docs_started == 0 ? 0 : docs_started - 1;
+    }
+
+    std::string docno(uint64_t doc_id) const
+    {
+        check_doc_id(doc_id);
+        auto begin = m_docnos.begin() + m_docno_starts[doc_id];
+        auto end = m_docnos.begin() + m_docno_starts[doc_id + 1];
+        return std::string(begin, end);
+    }
+
+    inline void check_doc_id(uint64_t doc_id) const
+    {
+        if (doc_id >= m_num_docs) {
+            throw std::runtime_error("Unknown document id " + std::to_string(doc_id) + " (" + std::to_string(m_num_docs) + " documents).");
+        }
+    }
+
+    /* returns num_docs() if the docno does not exist */
+    uint64_t doc_id(const std::string& docno_str) const
+    {
+        size_t lb = 0;
+        size_t rb = m_num_docs;
+        while (lb < rb) {
+            size_t mid = lb + (rb - lb) / 2;
+            if (docno(m_docno_order[mid]) < docno_str)
+                lb = mid + 1;
+            else
+                rb = mid;
+        }
+        if (lb < m_num_docs && docno(m_docno_order[lb]) == docno_str)
+            return m_docno_order[lb];
+        return m_num_docs;
+    }
+};
@@ -26,12 +26,94 @@ struct factor_coder_blocked {
     t_coder_literal literal_coder;
     t_coder_offset offset_coder;
     t_coder_len len_coder;
+    enum { trainable = coder::is_trainable<t_coder_literal>::value
+               || coder::is_trainable<t_coder_offset>::value
+               || coder::is_trainable<t_coder_len>::value };
+
+private:
+    std::vector<std::vector<uint8_t> > m_models; // literal, offset and length model, empty if untrained
+
+public:
     static std::string type()
     {
         return "factor_coder_blocked-t=" + std::to_string(t_literal_threshold)
             + "-" + t_coder_literal::type() + "-" + t_coder_offset::type() + "-" + t_coder_len::type();
     }
 
+    /* estimated bits of a factor of len > literal_threshold */
+    uint64_t factor_bits(uint32_t offset, uint32_t len) const
+    {
+        return coder::value_bits(len_coder, len - 1) + coder::value_bits(offset_coder, offset);
+    }
+
+    /* estimated bits of a literal factor of len <= literal_threshold */
+    template <class t_itr>
+    uint64_t literal_factor_bits(t_itr text_itr, uint32_t len) const
+    {
+        uint64_t bits = coder::value_bits(len_coder, len - 1);
+        for (uint32_t i = 0; i < len; i++)
+            bits += coder::value_bits(literal_coder, *(text_itr + i));
+        return bits;
+    }
+
+    /* train the models of the trainable sub-coders (see coder::rans_static
+       and coder::zlib_dict) on the factors of sample blocks. the models have
+       to be set before any block is encoded or decoded */
+    void train(const std::vector<block_factor_data>& samples)
+    {
+        std::vector<std::vector<uint8_t> > literals;
+        std::vector<std::vector<uint32_t> > offsets;
+        std::vector<std::vector<uint32_t> > lengths;
+        for (const auto& bfd : samples) {
+            literals.emplace_back(bfd.literals.begin(), bfd.literals.begin() + bfd.num_literals);
+            offsets.emplace_back(bfd.offsets.begin(), bfd.offsets.begin() + bfd.num_offsets);
+            lengths.emplace_back(bfd.lengths.begin(), bfd.lengths.begin() + bfd.num_factors);
+            for (auto& n : lengths.back())
+                n--; // as in encode_block
+        }
+        std::vector<std::vector<uint8_t> > models;
+        models.push_back(coder::train_model<t_coder_literal>(literals));
+        models.push_back(coder::train_model<t_coder_offset>(offsets));
+        models.push_back(coder::train_model<t_coder_len>(lengths));
+        set_models(models);
+    }
+
+    const std::vector<std::vector<uint8_t> >& models() const
+    {
+        return m_models;
+    }
+
+    void set_models(const std::vector<std::vector<uint8_t> >& models)
+    {
+        if (models.size() != 3) {
+            LOG(FATAL) << "factor_coder_blocked: expected 3 models, got " << models.size();
+        }
+        m_models = models;
+        coder::set_model(literal_coder, m_models[0]);
+        coder::set_model(offset_coder, m_models[1]);
+        coder::set_model(len_coder, m_models[2]);
+    }
+
+    void store_models(std::ostream& out) const
+    {
+        for (const auto& model : m_models) {
+            sdsl::int_vector<8> tmp(model.size());
+            std::copy(model.begin(), model.end(), tmp.begin());
+            tmp.serialize(out);
+        }
+    }
+
+    void load_models(std::istream& in)
+    {
+        std::vector<std::vector<uint8_t> > models(3);
+        for (auto& model : models) {
+            sdsl::int_vector<8> tmp;
+            tmp.load(in);
+            model.assign(tmp.begin(), tmp.end());
+        }
+        set_models(models);
+    }
+
     template <class t_ostream>
     void encode_block(t_ostream& ofs, block_factor_data& bfd) const
     {
@@ -99,6 +181,20 @@ public:
             + "-" + t_coder_offset::type() + "-" + t_coder_len::type();
     }
 
+    uint64_t factor_bits(uint32_t offset, uint32_t len) const
+    {
+        return coder::value_bits(len_coder, len - 1) + coder::value_bits(offsetliteral_coder, offset);
+    }
+
+    template <class t_itr>
+    uint64_t literal_factor_bits(t_itr text_itr, uint32_t len) const
+    {
+        uint64_t bits = coder::value_bits(len_coder, len - 1);
+        for (uint32_t i = 0; i < len; i++)
+            bits += coder::value_bits(offsetliteral_coder, *(text_itr + i));
+        return bits;
+    }
+
     template <class t_ostream>
     void encode_block(t_ostream& ofs, block_factor_data& bfd) const
     {
@@ -127,3 +223,21 @@ public:
         }
     }
 };
+
+/* give a decoder the models its factor coder was trained with, nothing to do
+   for coders without models */
+template <class t_factor_coder>
+void copy_models(const t_factor_coder& from, t_factor_coder& to, std::true_type)
+{
+    if (!from.models().empty())
+        to.set_models(from.models());
+}
+template <class t_factor_coder>
+void copy_models(const t_factor_coder&, t_factor_coder&, std::false_type)
+{
+}
+template <class t_factor_coder>
+void copy_models(const t_factor_coder& from, t_factor_coder& to)
+{
+    copy_models(from, to, coder::is_trainable<t_factor_coder>());
+}
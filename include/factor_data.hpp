@@ -35,6 +35,22 @@ struct block_factor_data {
         offset_literals.resize(block_size);
     }
 
+    /* copy of the used part of the buffers, e.g. to hand a block to another thread */
+    block_factor_data compact() const
+    {
+        block_factor_data bfd;
+        bfd.literals.assign(literals.begin(), literals.begin() + num_literals);
+        bfd.offsets.assign(offsets.begin(), offsets.begin() + num_offsets);
+        bfd.lengths.assign(lengths.begin(), lengths.begin() + num_factors);
+        bfd.offset_literals.assign(offset_literals.begin(), offset_literals.begin() + num_offset_literals);
+        bfd.num_factors = num_factors;
+        bfd.num_literals = num_literals;
+        bfd.num_offsets = num_offsets;
+        bfd.num_offset_literals = num_offset_literals;
+        bfd.last_factor_was_literal = last_factor_was_literal;
+        return bfd;
+    }
+
     template <class t_coder, class t_itr>
     void add_factor(t_coder& coder, t_itr text_itr, uint32_t offset, uint32_t len)
     {
@@ -3,6 +3,17 @@
 #include "utils.hpp"
 #include "collection.hpp"
 
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+/*
+    selectors pick the dictionary offset of the factor in [sp,ep]. prev_end
+    is the dictionary position following the previous dictionary factor of
+    the block, or no_previous_factor.
+ */
+const uint64_t no_previous_factor = std::numeric_limits<uint64_t>::max();
+
 struct factor_select_first {
     static std::string type()
     {
@@ -10,12 +21,9 @@ struct factor_select_first {
     }
 
     template <class t_index, class t_itr>
-    static uint32_t pick_offset(const t_index& idx, const t_itr factor_itr, bool local_search, uint32_t block_size)
+    static uint32_t pick_offset(const t_index& idx, const t_itr factor_itr, bool local_search, uint32_t block_size, uint64_t)
     {
         if (local_search) {
-            if (factor_itr.local) {
-                return factor_itr.local_offset;
-            }
             if (idx.is_reverse()) {
                 return block_size + (idx.sa.size() - (idx.sa[factor_itr.sp] + factor_itr.len) - 1);
             }
@@ -36,13 +44,81 @@ struct factor_select_last {
         return "factor_select_last";
     }
 
-    template <class t_index>
-    static uint32_t pick_offset(const t_index& idx, size_t, size_t ep, size_t factor_len)
+    template <class t_index, class t_itr>
+    static uint32_t pick_offset(const t_index& idx, const t_itr factor_itr, bool local_search, uint32_t block_size, uint64_t)
     {
+        uint32_t shift = local_search ? block_size : 0;
         if (idx.is_reverse()) {
-            return idx.sa.size() - (idx.sa[ep] + factor_len) - 1;
+            return shift + (idx.sa.size() - (idx.sa[factor_itr.ep] + factor_itr.len) - 1);
+        }
+        return shift + idx.sa[factor_itr.ep];
+    }
+};
+
+/*
+    picks the occurrence closest to the end of the previous dictionary factor
+    of the block (prev_end), so consecutive offsets cluster. this helps
+    offset coders like zlib and makes decoding touch fewer distinct parts
+    of the dictionary. only the first t_max_scan entries of [sp,ep] are
+    checked, since sa accesses are expensive for the csa indexes.
+ */
+template <uint32_t t_max_scan = 64>
+struct factor_select_nearest {
+    static std::string type()
+    {
+        return "factor_select_nearest-" + std::to_string(t_max_scan);
+    }
+
+    template <class t_index, class t_itr>
+    static uint32_t pick_offset(const t_index& idx, const t_itr factor_itr, bool local_search, uint32_t block_size, uint64_t prev_end)
+    {
+        auto offset = [&](uint64_t i) -> uint64_t {
+            if (idx.is_reverse())
+                return idx.sa.size() - (idx.sa[i] + factor_itr.len) - 1;
+            return idx.sa[i];
+        };
+        uint64_t best = offset(factor_itr.sp);
+        if (prev_end != no_previous_factor) {
+            auto dist = [&](uint64_t o) { return o > prev_end ? o - prev_end : prev_end - o; };
+            uint64_t best_dist = dist(best);
+            uint64_t last = std::min((uint64_t)factor_itr.ep, (uint64_t)factor_itr.sp + t_max_scan - 1);
+            for (uint64_t i = factor_itr.sp + 1; i <= last && best_dist != 0; i++) {
+                auto o = offset(i);
+                if (dist(o) < best_dist) {
+                    best = o;
+                    best_dist = dist(o);
+                }
+            }
         }
-        return idx.sa[ep];
+        return (local_search ? block_size : 0) + best;
+    }
+};
+
+
+/*
+    parse each block with the fewest estimated bits under the cost model of
+    the factor coder (see factorizor::factorize_block) instead of greedily
+    taking the longest factor. offsets are picked by t_selector.
+ */
+template <class t_selector = factor_select_first>
+struct factor_select_optimal {
+    enum { optimal_parse = true };
+    static std::string type()
+    {
+        return "factor_select_optimal-" + t_selector::type();
+    }
+
+    template <class t_index, class t_itr>
+    static uint32_t pick_offset(const t_index& idx, const t_itr factor_itr, bool local_search, uint32_t block_size, uint64_t prev_end)
+    {
+        return t_selector::template pick_offset<>(idx, factor_itr, local_search, block_size, prev_end);
     }
 };
 
+template <class t_selector, class = void>
+struct selects_optimal_parse : std::false_type {
+};
+
+template <class t_selector>
+struct selects_optimal_parse<t_selector, typename std::enable_if<t_selector::optimal_parse>::type> : std::true_type {
+};
@@ -5,6 +5,12 @@
 #include "factor_data.hpp"
 #include "bit_streams.hpp"
 
+#include <atomic>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
 struct factorization_info {
     uint64_t offset;
     uint64_t total_encoded_factors;
@@ -47,8 +53,16 @@ struct factorization_statistics {
     }
 };
 
+/*
+    counts how often each dictionary byte is copied. with local block context
+    search the offsets of dictionary factors are biased by the block size and
+    offsets below it are copies from the current block, which are skipped.
+ */
+template <bool t_search_local_block_context = false>
 struct factor_tracker {
     using result_type = factorization_statistics;
+    /* statistics are order independent, one tracker per thread suffices */
+    enum { per_chunk_output = 0 };
     factorization_statistics fs;
     hrclock::time_point encoding_start;
     block_factor_data tmp_block_factor_data;
@@ -84,11 +98,16 @@ struct factor_tracker {
         for (size_t i = 0; i < tmp_block_factor_data.num_factors; i++) {
             auto len = tmp_block_factor_data.lengths[i];
             if (len > coder.literal_threshold) {
-                auto offset = tmp_block_factor_data.offsets[offsets_seen];
+                uint64_t offset = tmp_block_factor_data.offsets[offsets_seen];
+                offsets_seen++;
+                if (t_search_local_block_context) {
+                    if (offset < fs.block_size)
+                        continue;
+                    offset -= fs.block_size;
+                }
                 for (size_t j = 0; j < len; j++) {
                     fs.dict_usage[offset + j]++;
                 }
-                offsets_seen++;
             }
         }
         fs.total_encoded_factors += tmp_block_factor_data.num_factors;
@@ -123,7 +142,7 @@ void output_encoding_stats(collection&, std::vector<factorization_statistics>&)
 
 template <class t_fact_strategy>
 factorization_statistics
-merge_factor_encodings(collection&, std::vector<factorization_statistics>& efs)
+merge_factor_encodings(collection&, std::vector<factorization_statistics>& efs, size_t = 0)
 {
     factorization_statistics fs;
     fs.block_size = efs[0].block_size;
@@ -136,8 +155,79 @@ merge_factor_encodings(collection&, std::vector<factorization_statistics>& efs)
     return fs;
 }
 
+/* the factors of a run of consecutive blocks of one chunk. passed from the
+   factor finding to the encoding stage of the pipelined factorization */
+struct factor_batch {
+    size_t chunk = 0;
+    size_t seq = 0;
+    bool last = false;
+    std::vector<block_factor_data> blocks;
+};
+
+/* encoded factor_batch. block i starts at bit block_offsets[i] of bits */
+struct encoded_factor_batch {
+    size_t chunk = 0;
+    size_t seq = 0;
+    bool last = false;
+    uint64_t num_factors = 0;
+    sdsl::bit_vector bits;
+    std::vector<uint64_t> block_offsets;
+    std::vector<uint64_t> block_factors;
+};
+
+template <class t_coder>
+encoded_factor_batch encode_factor_batch(t_coder& coder, factor_batch& batch)
+{
+    encoded_factor_batch eb;
+    eb.chunk = batch.chunk;
+    eb.seq = batch.seq;
+    eb.last = batch.last;
+    {
+        bit_ostream<sdsl::bit_vector> os(eb.bits);
+        for (auto& bfd : batch.blocks) {
+            eb.block_offsets.push_back(os.tellp());
+            eb.block_factors.push_back(bfd.num_factors);
+            eb.num_factors += bfd.num_factors;
+            coder.encode_block(os, bfd);
+        }
+    } // flush resizes bits to the encoded size
+    return eb;
+}
+
+/* collects the factors of each block instead of encoding them */
+struct factor_batcher {
+    block_factor_data tmp_block_factor_data;
+    std::vector<block_factor_data> blocks;
+    factor_batcher(size_t _block_size)
+    {
+        tmp_block_factor_data.resize(_block_size);
+    }
+    template <class t_coder, class t_itr>
+    void add_to_block_factor(t_coder& coder, t_itr text_itr, uint32_t offset, uint32_t len)
+    {
+        tmp_block_factor_data.add_factor(coder, text_itr, offset, len);
+    }
+    void start_new_block()
+    {
+        tmp_block_factor_data.reset();
+    }
+    template <class t_coder>
+    void encode_current_block(t_coder&)
+    {
+        blocks.push_back(tmp_block_factor_data.compact());
+    }
+    std::vector<block_factor_data> take()
+    {
+        std::vector<block_factor_data> tmp;
+        std::swap(tmp, blocks);
+        return tmp;
+    }
+};
+
 struct factor_storage {
     using result_type = factorization_info;
+    /* the encoded streams are concatenated in text order by merge_factor_encodings */
+    enum { per_chunk_output = 1 };
     uint64_t toffset;
     uint64_t block_size;
     uint64_t total_encoded_factors = 0;
@@ -159,6 +249,10 @@ struct factor_storage {
         , block_factors(sdsl::write_out_buffer<0>::create(col.temp_file_name(KEY_BLOCKFACTORS, toffset)))
         , factor_stream(factored_text)
     {
+        // one 64 bit word per entry: offsets need up to 64 bits and the
+        // merge writes the entries of different chunks concurrently
+        block_offsets.width(64);
+        block_factors.width(64);
         // create a buffer we can write to without reallocating
         tmp_block_factor_data.resize(block_size);
         // save the start of the encoding process
@@ -185,6 +279,24 @@ struct factor_storage {
         blocks_encoded_since_last_stats_output++;
         coder.encode_block(factor_stream, tmp_block_factor_data);
     }
+    /* append a batch encoded by another thread. the batch was encoded
+       starting at bit 0, so it is placed at a 64 bit boundary to keep the
+       byte alignment the coders rely on */
+    void append_encoded_batch(const encoded_factor_batch& eb)
+    {
+        factor_stream.align64();
+        auto batch_start = factor_stream.tellp();
+        for (size_t i = 0; i < eb.block_offsets.size(); i++) {
+            block_offsets.push_back(batch_start + eb.block_offsets[i]);
+            block_factors.push_back(eb.block_factors[i]);
+        }
+        total_encoded_factors += eb.num_factors;
+        factors_encoded_since_last_stats_output += eb.num_factors;
+        total_encoded_blocks += eb.block_offsets.size();
+        blocks_encoded_since_last_stats_output += eb.block_offsets.size();
+        if (eb.bits.size())
+            factor_stream.append(eb.bits);
+    }
     void output_stats(size_t total_blocks) 
     {
         auto cur_time = hrclock::now();
@@ -256,9 +368,17 @@ void output_encoding_stats(collection& col, std::vector<factorization_info>& efs
     LOG(INFO) << "=====================================================================";
 }
 
+/*
+    concatenate the per chunk factor streams. every chunk starts at a 64 bit
+    boundary of the merged stream (the bits between the end of a chunk and the
+    next boundary are unused padding), so the final files are resized once and
+    the chunks are copied word by word and their block offsets fixed up
+    independently of each other by num_threads threads.
+ */
 template <class t_fact_strategy>
 factorization_info
-merge_factor_encodings(collection& col, std::vector<factorization_info>& efs)
+merge_factor_encodings(collection& col, std::vector<factorization_info>& efs,
+    size_t num_threads = std::thread::hardware_concurrency())
 {
     auto dict_hash = col.param_map[PARAM_DICT_HASH];
     auto factor_file_name = t_fact_strategy::factor_file_name(col);
@@ -272,37 +392,74 @@ merge_factor_encodings(collection& col, std::vector<factorization_info>& efs)
     utils::rename_file(efs[0].block_factors_filename, bfactors_file_name);
     if (efs.size() != 1) { // append the rest and fix the offsets
         sdsl::int_vector_mapper<1> factored_text(factor_file_name);
-        bit_ostream<sdsl::int_vector_mapper<1> > factor_stream(factored_text, factored_text.size());
         sdsl::int_vector_mapper<0> block_offsets(boffsets_file_name);
         sdsl::int_vector_mapper<0> block_factors(bfactors_file_name);
+        if (block_offsets.width() != 64 || block_factors.width() != 64) {
+            /* chunks are copied in parallel, which is only safe if no two
+               entries share a word */
+            throw std::runtime_error("block offsets/counts must be stored with 64 bit entries");
+        }
 
+        /* (1) determine where each chunk goes */
+        std::vector<uint64_t> bit_starts(efs.size());
+        std::vector<uint64_t> block_starts(efs.size());
+        uint64_t total_bits = factored_text.size();
+        uint64_t total_blocks = block_offsets.size();
         for (size_t i = 1; i < efs.size(); i++) {
-            LOG(INFO) << "\tCopy block " << i << " factors/offsets/counts";
-            uint64_t foffset = factor_stream.tellp();
-            {
-                const sdsl::int_vector_mapper<1, std::ios_base::in> block_factor_text(efs[i].factored_text_filename);
-                auto src_bits = block_factor_text.size();
-                auto num_u64 = src_bits / 64;
-                auto src_data = block_factor_text.data();
-                factor_stream.write_int(src_data, num_u64, 64);
-                // write leftover bits
-                auto left = src_bits % 64;
-                for (size_t j = src_bits - left; j < src_bits; j++) {
-                    factor_stream.put(block_factor_text[j]);
+            bit_starts[i] = ((total_bits + 63) / 64) * 64;
+            block_starts[i] = total_blocks;
+            const sdsl::int_vector_mapper<1, std::ios_base::in> block_factor_text(efs[i].factored_text_filename);
+            total_bits = bit_starts[i] + block_factor_text.size();
+            total_blocks += efs[i].total_encoded_blocks;
+        }
+
+        /* (2) grow the output files once */
+        auto first_bits = factored_text.size();
+        factored_text.resize(total_bits);
+        block_offsets.resize(total_blocks);
+        block_factors.resize(total_blocks);
+        uint64_t* text_data = factored_text.data();
+        if (first_bits % 64 != 0) {
+            text_data[first_bits / 64] &= (1ULL << (first_bits % 64)) - 1;
+        }
+
+        /* (3) copy the chunks in parallel. all chunks write disjoint 64 bit words */
+        LOG(INFO) << "\tCopy " << efs.size() - 1 << " blocks of factors/offsets/counts";
+        std::atomic<size_t> next_chunk(1);
+        auto copy_chunks = [&] {
+            size_t i;
+            while ((i = next_chunk++) < efs.size()) {
+                {
+                    const sdsl::int_vector_mapper<1, std::ios_base::in> block_factor_text(efs[i].factored_text_filename);
+                    auto src_bits = block_factor_text.size();
+                    auto dst = text_data + bit_starts[i] / 64;
+                    std::memcpy(dst, block_factor_text.data(), ((src_bits + 63) / 64) * sizeof(uint64_t));
+                    if (src_bits % 64 != 0) {
+                        dst[src_bits / 64] &= (1ULL << (src_bits % 64)) - 1;
+                    }
                 }
-            }
-            {
-                // block offsets have to be adjusted to the appended position
-                const sdsl::int_vector_mapper<0, std::ios_base::in> block_block_offsets(efs[i].block_offset_filename);
-                for (const auto& off : block_block_offsets) {
-                    block_offsets.push_back(off + foffset);
+                {
+                    // block offsets have to be adjusted to the appended position
+                    const sdsl::int_vector_mapper<0, std::ios_base::in> block_block_offsets(efs[i].block_offset_filename);
+                    for (size_t j = 0; j < block_block_offsets.size(); j++) {
+                        block_offsets[block_starts[i] + j] = block_block_offsets[j] + bit_starts[i];
+                    }
+                }
+                const sdsl::int_vector_mapper<0, std::ios_base::in> block_block_factors(efs[i].block_factors_filename);
+                for (size_t j = 0; j < block_block_factors.size(); j++) {
+                    block_factors[block_starts[i] + j] = block_block_factors[j];
                 }
             }
-            const sdsl::int_vector_mapper<0, std::ios_base::in> block_block_factors(efs[i].block_factors_filename);
-            for (const auto& nf : block_block_factors) {
-                block_factors.push_back(nf);
-            }
+        };
+        num_threads = std::max(std::min(num_threads, efs.size() - 1), (size_t)1);
+        std::vector<std::future<void> > copiers;
+        for (size_t t = 0; t < num_threads; t++) {
+            copiers.push_back(std::async(std::launch::async, copy_chunks));
         }
+        for (auto& c : copiers) {
+            c.get();
+        }
+
         // delete all other files
         LOG(INFO) << "\tDelete temporary files";
         for (size_t i = 1; i < efs.size(); i++) {
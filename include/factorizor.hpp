@@ -3,15 +3,26 @@
 #include "utils.hpp"
 #include "collection.hpp"
 #include "factor_coder.hpp"
+#include "factor_selector.hpp"
 #include "bit_streams.hpp"
 #include "factor_storage.hpp"
 #include "timings.hpp"
+#include "concurrent_queue.hpp"
+#include "text_stream.hpp"
+#include "local_block_context.hpp"
 
 #include <sdsl/suffix_arrays.hpp>
 #include <sdsl/int_vector_mapped_buffer.hpp>
 
+#include <atomic>
 #include <cctype>
 #include <future>
+#include <limits>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 template <uint32_t t_block_size,
           bool t_search_local_block_context,
@@ -19,38 +30,76 @@ template <uint32_t t_block_size,
           class t_factor_selector,
           class t_coder>
 struct factorizor {
+    enum { search_local_block_context = t_search_local_block_context };
+
     static std::string type()
     {
         return "factorizor-" + std::to_string(t_block_size) + "-l" + std::to_string(t_search_local_block_context) + "-" + t_factor_selector::type() + "-" + t_coder::type();
     }
 
+    /* non-default block layouts (e.g. document aligned blocks) get their own files */
+    static std::string blocking_suffix(collection& col)
+    {
+        auto itr = col.param_map.find(PARAM_BLOCKING);
+        if (itr == col.param_map.end() || itr->second.empty())
+            return "";
+        return "-b=" + itr->second;
+    }
+
     static std::string factor_file_name(collection& col)
     {
         auto dict_hash = col.param_map[PARAM_DICT_HASH];
-        return col.path + "/index/" + type() + "-dhash=" + dict_hash + ".sdsl";
+        return col.path + "/index/" + type() + blocking_suffix(col) + "-dhash=" + dict_hash + ".sdsl";
     }
 
     static std::string boffsets_file_name(collection& col)
     {
         auto dict_hash = col.param_map[PARAM_DICT_HASH];
-        return col.path + "/index/" + KEY_BLOCKOFFSETS + "-fs=" + type() + "-dhash=" + dict_hash + ".sdsl";
+        return col.path + "/index/" + KEY_BLOCKOFFSETS + "-fs=" + type() + blocking_suffix(col) + "-dhash=" + dict_hash + ".sdsl";
     }
 
     static std::string bfactors_file_name(collection& col)
     {
         auto dict_hash = col.param_map[PARAM_DICT_HASH];
-        return col.path + "/index/" + KEY_BLOCKFACTORS + "-fs=" + type() + "-dhash=" + dict_hash + ".sdsl";
+        return col.path + "/index/" + KEY_BLOCKFACTORS + "-fs=" + type() + blocking_suffix(col) + "-dhash=" + dict_hash + ".sdsl";
     }
 
+    /* repeats inside the block if t_search_local_block_context is set */
+    typedef local_block_context<> local_context_type;
+
     template <class t_factor_store, class t_itr>
-    static void factorize_block(t_factor_store& fs, t_coder& coder, const t_index& idx, t_itr itr, t_itr end,std::unordered_map<uint64_t,utils::qgram_postings>& )
+    static void factorize_block(t_factor_store& fs, t_coder& coder, const t_index& idx, t_itr itr, t_itr end, local_context_type& local_ctx)
+    {
+        factorize_block(fs, coder, idx, itr, end, local_ctx, selects_optimal_parse<t_factor_selector>());
+    }
+
+    /* greedy parse: always take the longest factor */
+    template <class t_factor_store, class t_itr>
+    static void factorize_block(t_factor_store& fs, t_coder& coder, const t_index& idx, t_itr itr, t_itr end, local_context_type& local_ctx, std::false_type)
     {
-        uint64_t encoding_block_size = std::distance(itr,end);
         auto factor_itr = idx. template factorize<t_itr,t_search_local_block_context>(itr, end);
         fs.start_new_block();
         size_t syms_encoded = 0;
+        const size_t block_len = std::distance(itr, end);
+        if (t_search_local_block_context)
+            local_ctx.reset(block_len);
         double factors = 0;
+        uint64_t prev_end = no_previous_factor;
         while (!factor_itr.finished()) {
+            if (t_search_local_block_context) {
+                /* a longer repeat of earlier text of the block is encoded by
+                   its block position, dictionary offsets are shifted by the
+                   block size (see factor_select_*) */
+                auto local = local_ctx.find(itr, syms_encoded, block_len);
+                if (local.second > std::max((uint64_t)factor_itr.len, (uint64_t)coder.literal_threshold)) {
+                    fs.add_to_block_factor(coder, itr + syms_encoded, local.first, local.second);
+                    syms_encoded += local.second;
+                    factors++;
+                    local_ctx.advance(itr, syms_encoded, block_len);
+                    factor_itr.restart_at(syms_encoded);
+                    continue;
+                }
+            }
             if (factor_itr.len == 0) {
                 fs.add_to_block_factor(coder, itr + syms_encoded, 0, 1);
                 syms_encoded++;
@@ -58,12 +107,16 @@ struct factorizor {
                 uint64_t offset = 0;
                 {
                     // auto t = lm_bench::bench(timer_type::PickOffset);
-                    offset = t_factor_selector::template pick_offset<>(idx, factor_itr,t_search_local_block_context,encoding_block_size);
+                    offset = t_factor_selector::template pick_offset<>(idx, factor_itr, t_search_local_block_context, t_block_size, prev_end);
                 }
                 fs.add_to_block_factor(coder, itr + syms_encoded, offset, factor_itr.len);
+                if (factor_itr.len > coder.literal_threshold)
+                    prev_end = offset - (t_search_local_block_context ? t_block_size : 0) + factor_itr.len;
                 syms_encoded += factor_itr.len;
             }
             factors++;
+            if (t_search_local_block_context)
+                local_ctx.advance(itr, syms_encoded, block_len);
             {
                 // auto t = lm_bench::bench(timer_type::FindFactor);
                 ++factor_itr;
@@ -76,64 +129,305 @@ struct factorizor {
         // exit(EXIT_SUCCESS);
     }
 
+    /* cost optimal parse: shortest path over the factors of the block where
+       an edge costs the bits estimated by the coder. the longest dictionary
+       (and local) factor is searched at every position and, as in the
+       bit-optimal LZ77 parsing of Ferragina, Nitto and Venturini, only the
+       longest edge of each length cost class (powers of two) is relaxed.
+       any suffix of a factor is also a factor, so this keeps an optimal
+       path as long as offsets cost the same for all dictionary positions */
     template <class t_factor_store, class t_itr>
-    static typename t_factor_store::result_type
-    factorize(collection& col, t_index& idx, t_itr _itr, t_itr _end, size_t offset = 0)
+    static void factorize_block(t_factor_store& fs, t_coder& coder, const t_index& idx, t_itr itr, t_itr end, local_context_type& local_ctx, std::true_type)
     {
-        const sdsl::int_vector_mapped_buffer<8> text(col.file_map[KEY_TEXT]);
-        auto itr = text.begin() + _itr;
-        auto end = text.begin() + _end;
-        
-        std::unordered_map<uint64_t,utils::qgram_postings> qgc;
+        struct parse_edge {
+            uint32_t from = 0;
+            uint32_t len = 0;
+            uint32_t offset = 0;
+            bool literal = true;
+            uint64_t prev_end = no_previous_factor; // end of the last dictionary factor on the path
+        };
+        static_assert(t_coder::literal_threshold >= 1, "the optimal parse encodes unknown symbols as literals");
+        const size_t block_len = std::distance(itr, end);
+        const uint64_t literal_threshold = coder.literal_threshold;
+        std::vector<uint64_t> cost(block_len + 1, std::numeric_limits<uint64_t>::max());
+        std::vector<parse_edge> best(block_len + 1);
+        cost[0] = 0;
+        auto relax = [&](size_t from, uint64_t len, uint64_t offset, bool literal, uint64_t prev_end, uint64_t c) {
+            if (c < cost[from + len]) {
+                cost[from + len] = c;
+                auto& e = best[from + len];
+                e.from = from;
+                e.len = len;
+                e.offset = offset;
+                e.literal = literal;
+                e.prev_end = prev_end;
+            }
+        };
+        auto relax_factors = [&](size_t pos, uint64_t max_len, uint64_t offset, bool dict_factor) {
+            if (max_len <= literal_threshold)
+                return;
+            uint64_t dict_offset = offset - (t_search_local_block_context ? t_block_size : 0);
+            for (uint64_t len = 2; len < max_len; len *= 2) {
+                if (len > literal_threshold) {
+                    auto prev_end = dict_factor ? dict_offset + len : best[pos].prev_end;
+                    relax(pos, len, offset, false, prev_end, cost[pos] + coder.factor_bits(offset, len));
+                }
+            }
+            auto prev_end = dict_factor ? dict_offset + max_len : best[pos].prev_end;
+            relax(pos, max_len, offset, false, prev_end, cost[pos] + coder.factor_bits(offset, max_len));
+        };
 
-        /* (1) create output files */
-        t_factor_store fs(col, t_block_size, offset);
+        auto factor_itr = idx. template factorize<t_itr, t_search_local_block_context>(itr, end);
+        if (t_search_local_block_context)
+            local_ctx.reset(block_len);
+        for (size_t pos = 0; pos < block_len; pos++) {
+            if (pos != 0)
+                factor_itr.restart_at(pos);
+            for (uint64_t len = 1; len <= literal_threshold && pos + len <= block_len; len++) {
+                relax(pos, len, 0, true, best[pos].prev_end, cost[pos] + coder.literal_factor_bits(itr + pos, len));
+            }
+            if (factor_itr.len != 0) {
+                auto offset = t_factor_selector::template pick_offset<>(idx, factor_itr, t_search_local_block_context, t_block_size, best[pos].prev_end);
+                relax_factors(pos, factor_itr.len, offset, true);
+            }
+            if (t_search_local_block_context) {
+                local_ctx.advance(itr, pos, block_len);
+                auto local = local_ctx.find(itr, pos, block_len);
+                relax_factors(pos, local.second, local.first, false);
+            }
+        }
 
-        /* (2) create encoder  */
-        t_coder coder;
+        std::vector<parse_edge> parse;
+        for (size_t pos = block_len; pos != 0; pos = best[pos].from)
+            parse.push_back(best[pos]);
+        fs.start_new_block();
+        for (auto e = parse.rbegin(); e != parse.rend(); ++e) {
+            fs.add_to_block_factor(coder, itr + e->from, e->offset, e->len);
+        }
+        fs.encode_current_block(coder);
+    }
 
-        /* (3) compute text stats */
-        auto block_size = t_block_size;
-        size_t n = std::distance(itr, end);
-        size_t num_blocks = n / block_size;
-        auto left = n % block_size;
-        auto blocks_per_10mib = (10 * 1024 * 1024) / block_size;
-
-        /* (4) encode blocks */
-        for (size_t i = 1; i <= num_blocks; i++) {
-            auto block_end = itr + block_size;
-            // LOG(INFO) << "block " << i;
-            factorize_block(fs, coder, idx, itr, block_end,qgc);
-            itr = block_end;
-            block_end += block_size;
-            if (i % blocks_per_10mib == 0) {
-                fs.output_stats(num_blocks);
-                // lm_bench::print(offset);
-                // lm_bench::reset();
-            }
+    /* text range [begin,end) of block i. fixed size blocks if block_starts is empty */
+    static std::pair<uint64_t, uint64_t>
+    block_text_range(const sdsl::int_vector<>& block_starts, uint64_t text_size, size_t i)
+    {
+        if (block_starts.empty()) {
+            uint64_t begin = i * (uint64_t)t_block_size;
+            return { begin, std::min(begin + t_block_size, text_size) };
         }
+        uint64_t end = text_size;
+        if (i + 1 < block_starts.size())
+            end = block_starts[i + 1];
+        return { block_starts[i], end };
+    }
 
-        /* (5) is there a non-full block? */
-        if (left != 0) {
-            factorize_block(fs, coder, idx, itr, end,qgc);
+    /* factorize blocks [first_block,last_block) into an existing factor store.
+       chunk_text points to text position chunk_text_offset */
+    template <class t_factor_store, class t_itr>
+    static void factorize_chunk(t_factor_store& fs, t_coder& coder, const t_index& idx,
+        t_itr chunk_text, uint64_t chunk_text_offset, uint64_t text_size,
+        const sdsl::int_vector<>& block_starts, size_t first_block, size_t last_block)
+    {
+        local_context_type local_ctx(t_search_local_block_context ? t_block_size : 0);
+        for (size_t i = first_block; i < last_block; i++) {
+            auto range = block_text_range(block_starts, text_size, i);
+            auto block_begin = chunk_text + (range.first - chunk_text_offset);
+            auto block_end = chunk_text + (range.second - chunk_text_offset);
+            factorize_block(fs, coder, idx, block_begin, block_end, local_ctx);
+        }
+    }
+
+    /* factorize blocks [first_block,last_block) of a chunk in batches of
+       blocks_per_batch blocks which are handed to the encoder threads. a
+       token is put into in_flight for every batch and taken out by the
+       writer once the batch is written, so a stalled batch cannot make the
+       writer buffer an unbounded number of its successors.
+       returns false if the pipeline was shut down */
+    template <class t_itr>
+    static bool factorize_chunk_batches(concurrent_queue<factor_batch>& batches, concurrent_queue<char>& in_flight,
+        t_coder& coder, const t_index& idx,
+        t_itr chunk_text, uint64_t chunk_text_offset, uint64_t text_size,
+        const sdsl::int_vector<>& block_starts, size_t chunk, size_t first_block, size_t last_block,
+        size_t blocks_per_batch)
+    {
+        factor_batcher fb(t_block_size);
+        size_t seq = 0;
+        for (size_t i = first_block; i < last_block; i += blocks_per_batch) {
+            auto batch_end = std::min(i + blocks_per_batch, last_block);
+            factorize_chunk(fb, coder, idx, chunk_text, chunk_text_offset, text_size, block_starts, i, batch_end);
+            factor_batch batch;
+            batch.chunk = chunk;
+            batch.seq = seq++;
+            batch.last = batch_end == last_block;
+            batch.blocks = fb.take();
+            if (!in_flight.push(0) || !batches.push(std::move(batch)))
+                return false;
         }
-        
-        return fs.result();
+        return true;
+    }
+
+    /* append the encoded batches to one store per chunk. batches of the same
+       chunk arrive out of order and are buffered until their predecessors
+       have been written. the missing predecessor of a buffered batch was
+       already queued (batches of a chunk are queued in order), so buffering
+       holds at most as many batches as there are in_flight tokens */
+    template <class t_factor_store>
+    static void write_encoded_batches(collection& col, concurrent_queue<encoded_factor_batch>& encoded,
+        concurrent_queue<char>& in_flight, std::vector<typename t_factor_store::result_type>& chunk_results, std::true_type)
+    {
+        struct open_chunk {
+            std::unique_ptr<t_factor_store> fs;
+            size_t next_seq = 0;
+            std::map<size_t, encoded_factor_batch> pending;
+        };
+        std::map<size_t, open_chunk> open_chunks;
+        encoded_factor_batch eb;
+        while (encoded.pop(eb)) {
+            auto chunk = eb.chunk;
+            auto& oc = open_chunks[chunk];
+            if (!oc.fs)
+                oc.fs.reset(new t_factor_store(col, t_block_size, chunk));
+            oc.pending[eb.seq] = std::move(eb);
+            bool chunk_done = false;
+            auto itr = oc.pending.begin();
+            while (itr != oc.pending.end() && itr->first == oc.next_seq) {
+                oc.fs->append_encoded_batch(itr->second);
+                chunk_done = itr->second.last;
+                char token;
+                in_flight.pop(token);
+                oc.next_seq++;
+                itr = oc.pending.erase(itr);
+            }
+            if (chunk_done) {
+                chunk_results[chunk] = oc.fs->result();
+                open_chunks.erase(chunk);
+            }
+        }
+    }
+
+    template <class t_factor_store>
+    static void write_encoded_batches(collection&, concurrent_queue<encoded_factor_batch>&,
+        concurrent_queue<char>&, std::vector<typename t_factor_store::result_type>&, std::false_type)
+    {
+        throw std::logic_error("pipelined factorization requires a factor store with per chunk output");
+    }
+
+    /* number of encoder threads of the factorization pipeline (PARAM_ENCODE_THREADS), 0 encodes inline */
+    static uint32_t encode_threads(collection& col)
+    {
+        auto itr = col.param_map.find(PARAM_ENCODE_THREADS);
+        if (itr == col.param_map.end() || itr->second.empty())
+            return 0;
+        return std::stoul(itr->second);
+    }
+
+    /* size of the read buffers if the text is streamed (PARAM_STREAM_BUFFER), 0 if it is mmapped */
+    static uint64_t stream_buffer_bytes(collection& col)
+    {
+        auto itr = col.param_map.find(PARAM_STREAM_BUFFER);
+        if (itr == col.param_map.end() || itr->second.empty())
+            return 0;
+        return std::stoull(itr->second);
     }
 
     static std::string factorcoder_file_name(collection& col)
     {
         return col.path + "/index/" + KEY_FCODER + "-"
-               + t_coder::type() + "-" + type() + "-"
+               + t_coder::type() + "-" + type() + blocking_suffix(col) + "-"
                + col.param_map[PARAM_DICT_HASH] + ".sdsl";
     }
 
+    /* models of trainable coders are trained whenever the factors are
+       encoded, so a factor file exists only together with its model file */
+    static bool factorization_exists(collection& col)
+    {
+        return utils::file_exists(factor_file_name(col))
+            && (!coder::is_trainable<t_coder>::value || utils::file_exists(factorcoder_file_name(col)));
+    }
+
+    /* load the models of a trainable coder stored by train_coder. without a
+       model file the coder keeps its defaults (e.g. to gather statistics
+       during dictionary pruning), unless the models are required to decode */
+    static void load_coder_models(collection& col, t_coder& coder, bool required = false)
+    {
+        load_coder_models(col, coder, required, coder::is_trainable<t_coder>());
+    }
+
+    static void load_coder_models(collection& col, t_coder& coder, bool required, std::true_type)
+    {
+        auto file_name = factorcoder_file_name(col);
+        if (utils::file_exists(file_name)) {
+            std::ifstream ifs(file_name);
+            coder.load_models(ifs);
+        }
+        else if (required) {
+            throw std::runtime_error("LOAD FAILED: Cannot find factor coder models " + file_name);
+        }
+    }
+
+    static void load_coder_models(collection&, t_coder&, bool, std::false_type)
+    {
+    }
+
+    /* train the models of a trainable coder on the factors of sample blocks
+       and store them for the encoders and the decoders */
+    static void train_coder(collection& col, const std::vector<block_factor_data>& samples)
+    {
+        train_coder(col, samples, coder::is_trainable<t_coder>());
+    }
+
+    static void train_coder(collection& col, const std::vector<block_factor_data>& samples, std::true_type)
+    {
+        LOG(INFO) << "Train factor coder models on " << samples.size() << " blocks";
+        t_coder coder;
+        coder.train(samples);
+        std::ofstream ofs(factorcoder_file_name(col));
+        coder.store_models(ofs);
+    }
+
+    static void train_coder(collection&, const std::vector<block_factor_data>&, std::false_type)
+    {
+    }
+
+    /* train on the factors of up to max_samples evenly spaced blocks of the text */
+    static void train_coder(collection& col, const t_index& idx, size_t max_samples = 256)
+    {
+        train_coder(col, idx, max_samples, coder::is_trainable<t_coder>());
+    }
+
+    static void train_coder(collection& col, const t_index& idx, size_t max_samples, std::true_type)
+    {
+        const sdsl::int_vector_mapper<8, std::ios_base::in> text(col.file_map[KEY_TEXT]);
+        const uint8_t* text_ptr = (const uint8_t*)text.data();
+        sdsl::int_vector<> block_starts;
+        size_t num_blocks = (text.size() + t_block_size - 1) / t_block_size;
+        if (col.file_map.find(KEY_BLOCKSTARTS) != col.file_map.end()) {
+            sdsl::load_from_file(block_starts, col.file_map[KEY_BLOCKSTARTS]);
+            num_blocks = block_starts.size();
+        }
+        size_t num_samples = std::min(num_blocks, max_samples);
+        t_coder coder;
+        factor_batcher fb(t_block_size);
+        local_context_type local_ctx(t_search_local_block_context ? t_block_size : 0);
+        for (size_t i = 0; i < num_samples; i++) {
+            auto range = block_text_range(block_starts, text.size(), i * num_blocks / num_samples);
+            factorize_block(fb, coder, idx, text_ptr + range.first, text_ptr + range.second, local_ctx);
+        }
+        train_coder(col, fb.take());
+    }
+
+    static void train_coder(collection&, const t_index&, size_t, std::false_type)
+    {
+    }
+
     template <class t_factor_store>
     static typename t_factor_store::result_type
     parallel_factorize(collection& col, bool rebuild, uint32_t num_threads)
     {
         LOG(INFO) << "Create/Load dictionary index";
         t_index idx(col, rebuild);
+        if (t_factor_store::per_chunk_output) // the factors are encoded and stored, retrain with them
+            train_coder(col, idx);
         std::vector<typename t_factor_store::result_type> efs;
         {
             auto text_size = 0ULL;
@@ -145,28 +439,225 @@ struct factorizor {
             auto start_fact = hrclock::now();
             LOG(INFO) << "Factorize text - " << text_size_mb << " MiB (" << num_threads << " threads) - (" << type() << ")";
 
-            std::vector<std::future<typename t_factor_store::result_type> > fis;
-
-            auto num_blocks = text_size / t_block_size;
-            auto blocks_per_thread = num_blocks / num_threads;
-            auto syms_per_thread = blocks_per_thread * t_block_size;
-            auto left = text_size;
-            auto itr = 0ULL;
-            for (size_t i = 0; i < num_threads; i++) {
-                auto begin = itr;
-                auto end = begin + syms_per_thread;
-                if (left < 2 * syms_per_thread) // last thread might have to encode a little more
-                    end = text_size;
-                fis.push_back(std::async(std::launch::async, [&, begin, end, i] {
-                        return factorize<t_factor_store>(col,idx,begin,end,i);
+            /* cut the text into runs of blocks of roughly 64 MiB. the threads
+               grab the next unprocessed chunk when they are done with their
+               current one, so slow regions of the text do not leave the other
+               threads idle. */
+            sdsl::int_vector<> block_starts;
+            size_t num_blocks = (text_size + t_block_size - 1) / t_block_size;
+            if (col.file_map.find(KEY_BLOCKSTARTS) != col.file_map.end()) {
+                sdsl::load_from_file(block_starts, col.file_map[KEY_BLOCKSTARTS]);
+                num_blocks = block_starts.size();
+            }
+            const uint64_t buffer_bytes = stream_buffer_bytes(col);
+            const bool streaming = buffer_bytes != 0;
+            uint64_t chunk_bytes = 64ULL * 1024 * 1024;
+            if (streaming) // at least two chunks have to fit into the buffer budget
+                chunk_bytes = std::min(chunk_bytes, buffer_bytes / 2);
+            const size_t blocks_per_chunk = std::max((size_t)(chunk_bytes / t_block_size), (size_t)1);
+            const size_t num_chunks = (num_blocks + blocks_per_chunk - 1) / blocks_per_chunk;
+            num_threads = std::max(std::min((size_t)num_threads, num_chunks), (size_t)1);
+            LOG(INFO) << "Factorize " << num_chunks << " chunks of " << blocks_per_chunk << " blocks";
+
+            /* if the text is streamed, a reader thread fills a ring of buffers
+               with consecutive chunks using large sequential reads. peak memory
+               is the dictionary, the index and the buffer budget. */
+            const size_t num_buffers = streaming ? std::max((size_t)(buffer_bytes / (blocks_per_chunk * t_block_size)), (size_t)2) : 1;
+            concurrent_queue<text_chunk> filled_chunks(num_buffers);
+            concurrent_queue<std::vector<uint8_t> > free_buffers(num_buffers);
+            std::future<void> reader;
+            if (streaming) {
+                LOG(INFO) << "Stream text through " << num_buffers << " buffers of " << blocks_per_chunk * t_block_size << " bytes";
+                for (size_t i = 0; i < num_buffers; i++)
+                    free_buffers.push(std::vector<uint8_t>());
+                reader = std::async(std::launch::async, [&] {
+                    try {
+                        text_stream_reader text(col.file_map[KEY_TEXT]);
+                        for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+                            text_chunk c;
+                            if (!free_buffers.pop(c.data))
+                                break;
+                            c.id = chunk;
+                            c.first_block = chunk * blocks_per_chunk;
+                            c.last_block = std::min(c.first_block + blocks_per_chunk, num_blocks);
+                            c.text_offset = block_text_range(block_starts, text_size, c.first_block).first;
+                            auto text_end = block_text_range(block_starts, text_size, c.last_block - 1).second;
+                            text.read(c.text_offset, text_end - c.text_offset, c.data);
+                            filled_chunks.push(std::move(c));
+                        }
+                    }
+                    catch (...) {
+                        filled_chunks.close();
+                        throw;
+                    }
+                    filled_chunks.close();
+                });
+            }
+
+            /* stores whose output has to stay in text order (factor_storage)
+               get one store per chunk which is merged in chunk order. all
+               other stores are reused for all chunks of a thread. */
+            std::vector<typename t_factor_store::result_type> chunk_results(t_factor_store::per_chunk_output ? num_chunks : num_threads);
+
+            /* with encoder threads the factorization is pipelined: the
+               factorization threads hand batches of found factors to a pool
+               of encoder threads and a single writer appends the encoded
+               batches to the store of their chunk in block order */
+            const uint32_t num_encoders = t_factor_store::per_chunk_output ? encode_threads(col) : 0;
+            const bool pipelined = num_encoders != 0;
+            const size_t blocks_per_batch = std::max((size_t)((1024 * 1024) / t_block_size), (size_t)1);
+            concurrent_queue<factor_batch> factor_batches(2 * num_encoders);
+            concurrent_queue<encoded_factor_batch> encoded_batches(2 * num_encoders);
+            concurrent_queue<char> batches_in_flight(4 * (num_encoders + num_threads));
+            auto stop_pipeline = [&] {
+                batches_in_flight.close();
+                factor_batches.close();
+                encoded_batches.close();
+            };
+            std::vector<std::future<void> > encoders;
+            std::future<void> writer;
+            if (pipelined) {
+                LOG(INFO) << "Encode factors with " << num_encoders << " threads in batches of " << blocks_per_batch << " blocks";
+                for (size_t e = 0; e < num_encoders; e++) {
+                    encoders.push_back(std::async(std::launch::async, [&] {
+                        try {
+                            t_coder coder;
+                            load_coder_models(col, coder);
+                            factor_batch batch;
+                            while (factor_batches.pop(batch)) {
+                                if (!encoded_batches.push(encode_factor_batch(coder, batch)))
+                                    break;
+                            }
+                        }
+                        catch (...) {
+                            stop_pipeline();
+                            throw;
+                        }
+                    }));
+                }
+                writer = std::async(std::launch::async, [&] {
+                    try {
+                        write_encoded_batches<t_factor_store>(col, encoded_batches, batches_in_flight, chunk_results,
+                            std::integral_constant<bool, t_factor_store::per_chunk_output>());
+                    }
+                    catch (...) {
+                        stop_pipeline();
+                        throw;
+                    }
+                });
+            }
+
+            std::atomic<size_t> next_chunk(0);
+            std::atomic<size_t> chunks_done(0);
+            std::vector<std::future<void> > fis;
+            for (size_t t = 0; t < num_threads; t++) {
+                fis.push_back(std::async(std::launch::async, [&, t] {
+                    t_coder coder;
+                    load_coder_models(col, coder);
+                    std::unique_ptr<t_factor_store> fs;
+                    if (!t_factor_store::per_chunk_output)
+                        fs.reset(new t_factor_store(col, t_block_size, t));
+                    auto start_chunk = [&](size_t chunk) {
+                        if (t_factor_store::per_chunk_output && !pipelined)
+                            fs.reset(new t_factor_store(col, t_block_size, chunk));
+                    };
+                    auto finish_chunk = [&](size_t chunk) {
+                        if (t_factor_store::per_chunk_output && !pipelined) {
+                            chunk_results[chunk] = fs->result();
+                            fs.reset();
+                        }
+                        auto done = ++chunks_done;
+                        if (done % std::max(num_chunks / 10, (size_t)1) == 0) {
+                            LOG(INFO) << "   (" << t << ") " << done << "/" << num_chunks << " chunks factorized";
+                        }
+                    };
+                    if (streaming) {
+                        try {
+                            text_chunk c;
+                            while (filled_chunks.pop(c)) {
+                                start_chunk(c.id);
+                                const uint8_t* chunk_text = c.data.data();
+                                if (pipelined) {
+                                    if (!factorize_chunk_batches(factor_batches, batches_in_flight, coder, idx, chunk_text, c.text_offset, text_size,
+                                            block_starts, c.id, c.first_block, c.last_block, blocks_per_batch)) {
+                                        free_buffers.close();
+                                        break;
+                                    }
+                                }
+                                else {
+                                    factorize_chunk(*fs, coder, idx, chunk_text, c.text_offset, text_size,
+                                        block_starts, c.first_block, c.last_block);
+                                }
+                                finish_chunk(c.id);
+                                free_buffers.push(std::move(c.data));
+                            }
+                        }
+                        catch (...) {
+                            // make sure the reader does not wait for buffers forever
+                            free_buffers.close();
+                            throw;
+                        }
+                    }
+                    else {
+                        /* factorize from raw pointers so matches can be extended
+                           with the vectorized match_length */
+                        const sdsl::int_vector_mapper<8, std::ios_base::in> text(col.file_map[KEY_TEXT]);
+                        const uint8_t* text_ptr = (const uint8_t*)text.data();
+                        size_t chunk;
+                        while ((chunk = next_chunk++) < num_chunks) {
+                            start_chunk(chunk);
+                            auto first_block = chunk * blocks_per_chunk;
+                            auto last_block = std::min(first_block + blocks_per_chunk, num_blocks);
+                            if (pipelined) {
+                                if (!factorize_chunk_batches(factor_batches, batches_in_flight, coder, idx, text_ptr, 0, text_size,
+                                        block_starts, chunk, first_block, last_block, blocks_per_batch))
+                                    break;
+                            }
+                            else {
+                                factorize_chunk(*fs, coder, idx, text_ptr, 0, text_size,
+                                    block_starts, first_block, last_block);
+                            }
+                            finish_chunk(chunk);
+                        }
+                    }
+                    if (!t_factor_store::per_chunk_output)
+                        chunk_results[t] = fs->result();
                 }));
-                itr += syms_per_thread;
-                left -= syms_per_thread;
             }
             // wait for all threads to finish
-            for (auto& fi : fis) {
-                auto f = fi.get();
-                efs.push_back(f);
+            try {
+                for (auto& fi : fis) {
+                    fi.get();
+                }
+                if (streaming) {
+                    reader.get();
+                }
+            }
+            catch (...) {
+                stop_pipeline();
+                throw;
+            }
+            if (pipelined) {
+                // drain the encoder and writer stages
+                factor_batches.close();
+                try {
+                    for (auto& e : encoders) {
+                        e.get();
+                    }
+                }
+                catch (...) {
+                    stop_pipeline();
+                    throw;
+                }
+                encoded_batches.close();
+                writer.get();
+            }
+            efs = std::move(chunk_results);
+            if (efs.empty()) {
+                /* an empty text has no chunks. the merge still needs one
+                   (empty) store to produce the output files */
+                t_factor_store fs(col, t_block_size, 0);
+                efs.push_back(fs.result());
             }
 
             auto stop_fact = hrclock::now();
@@ -180,6 +671,6 @@ struct factorizor {
         output_encoding_stats(col, efs);
 
         LOG(INFO) << "Merge factorized text blocks";
-        return merge_factor_encodings<factorizor<t_block_size,t_search_local_block_context, t_index, t_factor_selector, t_coder> >(col, efs);
+        return merge_factor_encodings<factorizor<t_block_size,t_search_local_block_context, t_index, t_factor_selector, t_coder> >(col, efs, num_threads);
     }
 };
@@ -112,10 +112,10 @@ public:
     text_iterator(t_idx& idx, size_t text_offset)
         : m_idx(idx)
         , m_text_offset(text_offset)
-        , m_text_block_offset(text_offset % m_idx.encoding_block_size)
         , m_block_size(m_idx.encoding_block_size)
-        , m_block_offset(text_offset / m_idx.encoding_block_size)
+        , m_block_offset(m_idx.block_of(text_offset))
     {
+        m_text_block_offset = text_offset - m_idx.block_text_start(m_block_offset);
         m_block_factor_data.resize(m_block_size);
         m_text_buf.resize(m_block_size);
     }
@@ -153,8 +153,8 @@ public:
 
     void seek(size_type new_text_offset)
     {
-        auto new_block_offset = new_text_offset / m_block_size;
-        m_text_block_offset = new_text_offset % m_block_size;
+        auto new_block_offset = m_idx.block_of(new_text_offset);
+        m_text_block_offset = new_text_offset - m_idx.block_text_start(new_block_offset);
         if (new_block_offset != m_block_offset) {
             m_block_offset = new_block_offset;
             if (m_text_block_offset != 0)
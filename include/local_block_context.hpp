@@ -0,0 +1,143 @@
+#pragma once
+
+#include "match_length.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/*
+    finds repeats inside the current block for t_search_local_block_context.
+    the 8-grams starting at the already factorized positions of the block are
+    kept in an open addressing hash table. each slot points to the most
+    recent position of its 8-gram, older positions of the same 8-gram are
+    chained through a block local arena. slots are tagged with the number of
+    the block which wrote them, so starting a new block is O(1). the table
+    has at least twice as many slots as the block has positions, so linear
+    probing always terminates.
+
+    at most t_max_candidates positions (the most recent ones) are checked per
+    query. matches never overlap the position they are searched for, so the
+    decoder can copy them from the already decoded part of the block.
+ */
+template <uint32_t t_max_candidates = 16>
+class local_block_context {
+public:
+    enum { qgram_len = 8 };
+
+private:
+    static const uint32_t none = std::numeric_limits<uint32_t>::max();
+    struct slot {
+        uint64_t qgram = 0;
+        uint32_t pos = 0;
+        uint32_t block = 0;
+    };
+    std::vector<slot> m_slots;
+    std::vector<uint32_t> m_prev;
+    uint64_t m_mask = 0;
+    uint32_t m_block = 0;
+    size_t m_indexed = 0; // positions [0,m_indexed) of the block are in the table
+
+    template <class t_itr>
+    static inline uint64_t load_qgram(t_itr itr)
+    {
+        uint64_t qgram = 0;
+        for (size_t i = 0; i < qgram_len; i++) {
+            qgram |= uint64_t(*itr) << (8 * i);
+            ++itr;
+        }
+        return qgram;
+    }
+
+    inline size_t first_slot(uint64_t qgram) const
+    {
+        return ((qgram * 0x9E3779B97F4A7C15ULL) >> 32) & m_mask;
+    }
+
+    void grow(size_t block_len)
+    {
+        size_t num_slots = 1;
+        while (num_slots < 2 * block_len)
+            num_slots *= 2;
+        m_slots.assign(num_slots, slot());
+        m_mask = num_slots - 1;
+        m_prev.resize(block_len);
+        m_block = 0;
+    }
+
+public:
+    local_block_context(size_t block_size = 0)
+    {
+        grow(std::max(block_size, (size_t)1));
+    }
+
+    /* forget all positions of the previous block */
+    void reset(size_t block_len)
+    {
+        if (block_len > m_prev.size())
+            grow(block_len);
+        if (++m_block == 0) { // block number wrapped around, clear the tags
+            for (auto& s : m_slots)
+                s.block = 0;
+            m_block = 1;
+        }
+        m_indexed = 0;
+    }
+
+    /* add the 8-grams starting at positions [m_indexed,pos) of the block */
+    template <class t_itr>
+    void advance(t_itr block_begin, size_t pos, size_t block_len)
+    {
+        size_t last = std::min(pos, block_len >= qgram_len ? block_len - qgram_len + 1 : 0);
+        for (size_t p = m_indexed; p < last; p++) {
+            auto qgram = load_qgram(block_begin + p);
+            auto s = first_slot(qgram);
+            while (m_slots[s].block == m_block && m_slots[s].qgram != qgram)
+                s = (s + 1) & m_mask;
+            if (m_slots[s].block == m_block) {
+                m_prev[p] = m_slots[s].pos;
+            }
+            else {
+                m_prev[p] = none;
+                m_slots[s].block = m_block;
+                m_slots[s].qgram = qgram;
+            }
+            m_slots[s].pos = p;
+        }
+        m_indexed = std::max(m_indexed, pos);
+    }
+
+    /* (block position,length) of the longest earlier repeat of the text at pos,
+       length 0 if there is no repeat of at least 8 symbols */
+    template <class t_itr>
+    std::pair<uint64_t, uint64_t> find(t_itr block_begin, size_t pos, size_t block_len) const
+    {
+        std::pair<uint64_t, uint64_t> best(0, 0);
+        if (pos + qgram_len > block_len)
+            return best;
+        auto qgram = load_qgram(block_begin + pos);
+        auto s = first_slot(qgram);
+        while (m_slots[s].block == m_block && m_slots[s].qgram != qgram)
+            s = (s + 1) & m_mask;
+        if (m_slots[s].block != m_block)
+            return best;
+        uint32_t cand = m_slots[s].pos;
+        for (size_t checked = 0; cand != none && checked < t_max_candidates; checked++) {
+            if (pos - cand >= qgram_len) {
+                uint64_t max_len = std::min(pos - cand, block_len - pos);
+                auto len = match_length(block_begin + cand, block_begin + pos, max_len);
+                if (len > best.second) {
+                    best = { cand, len };
+                    if (len == max_len && max_len == block_len - pos)
+                        break;
+                }
+            }
+            cand = m_prev[cand];
+        }
+        if (best.second < qgram_len)
+            best.second = 0;
+        return best;
+    }
+};
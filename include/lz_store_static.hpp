@@ -8,6 +8,9 @@
 #include "factor_selector.hpp"
 #include "factorizor.hpp"
 #include "factor_coder.hpp"
+#include "block_cache.hpp"
+#include "block_batch.hpp"
+#include "document_map.hpp"
 
 #include <sdsl/suffix_arrays.hpp>
 
@@ -26,6 +29,8 @@ private:
     sdsl::int_vector_mapper<1, std::ios_base::in> m_compressed_text;
     bit_istream<sdsl::int_vector_mapper<1, std::ios_base::in> > m_compressed_stream;
     block_map_type m_blockmap;
+    document_map m_docmap;
+    mutable std::vector<uint8_t> m_extract_text;
 
 public:
     enum { block_size = t_block_size };
@@ -39,6 +44,22 @@ public:
 public:
     class builder;
 
+    /* per-thread decoding state, see rlz_store_static::decode_context */
+    class decode_context {
+    public:
+        bit_istream<sdsl::int_vector_mapper<1, std::ios_base::in> > compressed_stream;
+        coder_type coder;
+        std::vector<uint8_t> text;
+
+        decode_context(const lz_store_static& store)
+            : compressed_stream(store.m_compressed_text)
+            , text(store.encoding_block_size)
+        {
+        }
+        decode_context(const decode_context&) = delete;
+        decode_context& operator=(const decode_context&) = delete;
+    };
+
     static std::string type()
     {
         return coder_type::type() + "-" + std::to_string(t_block_size);
@@ -54,7 +75,11 @@ public:
         LOG(INFO) << "Loading Zlib store into memory (" << type() << ")";
         // (2) load the block map
         LOG(INFO) << "\tLoad block map";
-        sdsl::load_from_file(m_blockmap, col.file_map[KEY_BLOCKMAP]);
+        load_block_map(m_blockmap, col);
+        if (col.file_map.find(KEY_DOCMAP) != col.file_map.end()) {
+            LOG(INFO) << "\tLoad document map";
+            sdsl::load_from_file(m_docmap, col.file_map[KEY_DOCMAP]);
+        }
         {
             LOG(INFO) << "\tDetermine text size";
             const sdsl::int_vector_mapper<8, std::ios_base::in> text(col.file_map[KEY_TEXT]);
@@ -78,25 +103,136 @@ public:
         return text_size;
     }
 
+    /* text position of the first byte of a block (text_size for block_id == num_blocks) */
+    inline uint64_t block_text_start(uint64_t block_id) const
+    {
+        return std::min(block_id * encoding_block_size, text_size);
+    }
+
+    /* id of the block containing the text position */
+    inline uint64_t block_of(uint64_t text_pos) const
+    {
+        return text_pos / encoding_block_size;
+    }
+
+    inline size_type num_docs() const
+    {
+        return m_docmap.num_docs();
+    }
+
+    /* returns the id of the document with the given docno */
+    uint64_t doc_id(const std::string& docno) const
+    {
+        auto id = m_docmap.doc_id(docno);
+        if (id == m_docmap.num_docs()) {
+            throw std::runtime_error("Unknown docno '" + docno + "'.");
+        }
+        return id;
+    }
+
+    /* document text. only the blocks overlapping the document are decoded */
+    std::vector<uint8_t> document(uint64_t doc_id) const
+    {
+        auto range = m_docmap.document_range(doc_id);
+        std::vector<uint8_t> doc(range.second - range.first);
+        extract(range.first, doc.size(), doc.data());
+        return doc;
+    }
+
+    std::vector<uint8_t> document(uint64_t doc_id, decode_context& ctx) const
+    {
+        auto range = m_docmap.document_range(doc_id);
+        std::vector<uint8_t> doc(range.second - range.first);
+        extract(range.first, doc.size(), doc.data(), ctx);
+        return doc;
+    }
+
+    std::vector<uint8_t> document(const std::string& docno) const
+    {
+        return document(doc_id(docno));
+    }
+
+    std::vector<uint8_t> document(const std::string& docno, decode_context& ctx) const
+    {
+        return document(doc_id(docno), ctx);
+    }
+
     size_type size_in_bytes() const
     {
         return (m_compressed_text.size() >> 3) + m_blockmap.size_in_bytes();
     }
 
     inline uint64_t decode_block(uint64_t block_id, std::vector<uint8_t>& text, block_factor_data&) const
+    {
+        return decode_block(block_id, text.data(), m_compressed_stream, coder);
+    }
+
+    /* thread-safe: only touches the state in ctx */
+    inline uint64_t decode_block(uint64_t block_id, decode_context& ctx) const
+    {
+        return decode_block(block_id, ctx.text.data(), ctx.compressed_stream, ctx.coder);
+    }
+
+    template <class t_istream>
+    inline uint64_t decode_block(uint64_t block_id, uint8_t* out, t_istream& compressed_stream, const coder_type& block_coder) const
     {
         auto offset = m_blockmap.block_offset(block_id);
-        m_compressed_stream.seek(offset);
+        compressed_stream.seek(offset);
         size_t out_size = block_size;
         if (block_id == m_blockmap.num_blocks() - 1) {
             auto left = text_size % block_size;
             if (left != 0)
                 out_size = left;
         }
-        coder.decode(m_compressed_stream, text.data(), out_size);
+        block_coder.decode(compressed_stream, out, out_size);
         return out_size;
     }
 
+    /*
+        copy text[offset,offset+len) to out and return the number of bytes written.
+        blocks fully covered by the range are decoded straight into out, partially
+        covered ones go through a block sized buffer.
+     */
+    uint64_t extract(uint64_t offset, uint64_t len, uint8_t* out) const
+    {
+        return extract(offset, len, out, m_extract_text, m_compressed_stream, coder);
+    }
+
+    /* thread-safe: only touches the state in ctx */
+    uint64_t extract(uint64_t offset, uint64_t len, uint8_t* out, decode_context& ctx) const
+    {
+        return extract(offset, len, out, ctx.text, ctx.compressed_stream, ctx.coder);
+    }
+
+    template <class t_istream>
+    uint64_t extract(uint64_t offset, uint64_t len, uint8_t* out, std::vector<uint8_t>& text,
+        t_istream& compressed_stream, const coder_type& block_coder) const
+    {
+        if (offset >= text_size)
+            return 0;
+        auto end = std::min(offset + len, text_size);
+        auto block_id = block_of(offset);
+        auto block_begin = block_text_start(block_id);
+        auto out_itr = out;
+        while (block_begin < end) {
+            auto block_end = block_text_start(block_id + 1);
+            if (offset <= block_begin && block_end <= end) {
+                out_itr += decode_block(block_id, out_itr, compressed_stream, block_coder);
+            }
+            else {
+                if (text.size() < encoding_block_size)
+                    text.resize(encoding_block_size);
+                decode_block(block_id, text.data(), compressed_stream, block_coder);
+                auto from = std::max(offset, block_begin) - block_begin;
+                auto to = std::min(end, block_end) - block_begin;
+                out_itr = std::copy(text.begin() + from, text.begin() + to, out_itr);
+            }
+            block_id++;
+            block_begin = block_end;
+        }
+        return std::distance(out, out_itr);
+    }
+
     std::vector<uint8_t>
     block(const size_t block_id) const
     {
@@ -106,6 +242,34 @@ public:
             block_content.resize(out_size);
         return block_content;
     }
+
+    std::vector<uint8_t>
+    block(const size_t block_id, decode_context& ctx) const
+    {
+        auto out_size = decode_block(block_id, ctx);
+        return std::vector<uint8_t>(ctx.text.begin(), ctx.text.begin() + out_size);
+    }
+
+    /* decoded block served from (and inserted into) the shared block cache */
+    template <class t_cache>
+    cached_block_ptr block(const size_t block_id, t_cache& cache, decode_context& ctx) const
+    {
+        return cache.get(block_id, [&] { return block(block_id, ctx); });
+    }
+
+    /* hint the kernel to read in the encoded data of the given sorted blocks */
+    void prefetch_blocks(const std::vector<uint64_t>& sorted_ids) const
+    {
+        prefetch_encoded_blocks(m_blockmap, m_compressed_text, sorted_ids);
+    }
+
+    /* decode a batch of blocks in parallel, see decode_blocks_batched */
+    template <class t_callback>
+    void blocks(const std::vector<uint64_t>& ids, t_callback callback,
+        size_t num_threads = std::thread::hardware_concurrency()) const
+    {
+        decode_blocks_batched(*this, ids, callback, num_threads);
+    }
 };
 
 template <class t_coder, uint32_t t_block_size>
@@ -247,6 +411,9 @@ public:
         }
         col.file_map[KEY_BLOCKMAP] = blockmap_file;
 
+        // (5) map documents to text ranges
+        document_map::create(col, rebuild);
+
         auto stop = hrclock::now();
         LOG(INFO) << "LZ construction complete. time = " << duration_cast<seconds>(stop - start).count() << " sec";
 
@@ -274,6 +441,11 @@ public:
             col.file_map[KEY_BLOCKMAP] = blockmap_file;
         }
 
+        /* (3) register the document map if there is one */
+        if (utils::file_exists(document_map::file_name(col))) {
+            col.file_map[KEY_DOCMAP] = document_map::file_name(col);
+        }
+
         /* load */
         return lz_store_static(col);
     }
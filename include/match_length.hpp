@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+/*
+    number of equal leading symbols of a and b, at most max_len. generic
+    iterators are compared one symbol at a time.
+ */
+template <class t_itr_a, class t_itr_b>
+inline uint64_t match_length(t_itr_a a, t_itr_b b, uint64_t max_len)
+{
+    uint64_t len = 0;
+    while (len < max_len && *a == *b) {
+        ++a;
+        ++b;
+        ++len;
+    }
+    return len;
+}
+
+/*
+    byte arrays compare 32 (AVX2) or 16 (SSE4.2) bytes per step, depending on
+    the flags set by the CheckSSE probe, then 8 bytes per step and the rest
+    one byte at a time. never reads beyond a + max_len or b + max_len.
+ */
+inline uint64_t match_length(const uint8_t* a, const uint8_t* b, uint64_t max_len)
+{
+    uint64_t len = 0;
+#if defined(__AVX2__)
+    while (len + 32 <= max_len) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(a + len));
+        __m256i y = _mm256_loadu_si256((const __m256i*)(b + len));
+        uint32_t neq = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+        if (neq)
+            return len + __builtin_ctz(neq);
+        len += 32;
+    }
+#endif
+#if defined(__AVX2__) || defined(__SSE4_2__)
+    while (len + 16 <= max_len) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + len));
+        __m128i y = _mm_loadu_si128((const __m128i*)(b + len));
+        uint32_t neq = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) & 0xFFFF;
+        if (neq)
+            return len + __builtin_ctz(neq);
+        len += 16;
+    }
+#endif
+    while (len + 8 <= max_len) { // assumes a little endian machine
+        uint64_t x, y;
+        std::memcpy(&x, a + len, 8);
+        std::memcpy(&y, b + len, 8);
+        uint64_t diff = x ^ y;
+        if (diff)
+            return len + (__builtin_ctzll(diff) >> 3);
+        len += 8;
+    }
+    while (len < max_len && a[len] == b[len])
+        len++;
+    return len;
+}
@@ -10,6 +10,10 @@
 #include "factor_coder.hpp"
 #include "dict_strategies.hpp"
 #include "dict_indexes.hpp"
+#include "block_cache.hpp"
+#include "block_batch.hpp"
+#include "document_map.hpp"
+#include "static_dictionary.hpp"
 
 #include <sdsl/suffix_arrays.hpp>
 
@@ -38,15 +42,18 @@ public:
 private:
     sdsl::int_vector_mapper<1, std::ios_base::in> m_factored_text;
     bit_istream<sdsl::int_vector_mapper<1, std::ios_base::in> > m_factor_stream;
-    sdsl::int_vector<8> m_dict;
+    static_dictionary m_dict;
     block_map_type m_blockmap;
+    document_map m_docmap;
+    mutable block_factor_data m_extract_bfd;
+    mutable std::vector<uint8_t> m_extract_text;
 
 public:
     enum { block_size = t_factorization_block_size };
     enum { search_local_block_context = t_search_local_block_context };
     uint64_t encoding_block_size = block_size;
     block_map_type& block_map = m_blockmap;
-    sdsl::int_vector<8>& dict = m_dict;
+    static_dictionary& dict = m_dict;
     factor_coder_type m_factor_coder;
     sdsl::int_vector_mapper<1, std::ios_base::in>& factor_text = m_factored_text;
     uint64_t text_size;
@@ -57,6 +64,30 @@ public:
 public:
     class builder;
 
+    /*
+        per-thread decoding state. the position in the factor stream and the
+        (possibly stateful) entropy coders are the only mutable parts of the store,
+        so each thread decoding concurrently has to use its own context while the
+        mmapped factors, the dictionary and the block map are shared.
+     */
+    class decode_context {
+    public:
+        bit_istream<sdsl::int_vector_mapper<1, std::ios_base::in> > factor_stream;
+        factor_coder_type factor_coder;
+        block_factor_data bfd;
+        std::vector<uint8_t> text;
+
+        decode_context(const rlz_store_static& store)
+            : factor_stream(store.m_factored_text)
+            , bfd(store.encoding_block_size)
+            , text(store.encoding_block_size)
+        {
+            copy_models(store.m_factor_coder, factor_coder);
+        }
+        decode_context(const decode_context&) = delete;
+        decode_context& operator=(const decode_context&) = delete;
+    };
+
     std::string type() const
     {
         auto dict_size_mb = dict.size() / (1024 * 1024);
@@ -72,18 +103,24 @@ public:
     rlz_store_static(collection& col)
         : m_factored_text(col.file_map[KEY_FACTORIZED_TEXT])
         , m_factor_stream(m_factored_text) // (1) mmap factored text
+        , m_extract_bfd(block_size)
     {
         LOG(INFO) << "Loading RLZ store into memory";
         m_factor_file = col.file_map[KEY_FACTORIZED_TEXT];
         // (2) load the block map
         LOG(INFO) << "\tLoad block map";
-        sdsl::load_from_file(m_blockmap, col.file_map[KEY_BLOCKMAP]);
+        load_block_map(m_blockmap, col);
+        if (col.file_map.find(KEY_DOCMAP) != col.file_map.end()) {
+            LOG(INFO) << "\tLoad document map";
+            sdsl::load_from_file(m_docmap, col.file_map[KEY_DOCMAP]);
+        }
 
         // (3) load dictionary from disk
         LOG(INFO) << "\tLoad dictionary";
         m_dict_hash = col.param_map[PARAM_DICT_HASH];
         m_dict_file = col.file_map[KEY_DICT];
-        sdsl::load_from_file(m_dict, col.file_map[KEY_DICT]);
+        m_dict = static_dictionary(col);
+        factorization_strategy::load_coder_models(col, m_factor_coder, true);
         {
             LOG(INFO) << "\tDetermine text size";
             const sdsl::int_vector_mapper<8, std::ios_base::in> text(col.file_map[KEY_TEXT]);
@@ -117,6 +154,68 @@ public:
         return text_size;
     }
 
+    /* text position of the first byte of a block (text_size for block_id == num_blocks) */
+    inline uint64_t block_text_start(uint64_t block_id) const
+    {
+        if (m_blockmap.variable_block_sizes()) {
+            if (block_id >= m_blockmap.num_blocks())
+                return text_size;
+            return m_blockmap.block_text_start(block_id);
+        }
+        return std::min(block_id * encoding_block_size, text_size);
+    }
+
+    /* id of the block containing the text position */
+    inline uint64_t block_of(uint64_t text_pos) const
+    {
+        if (m_blockmap.variable_block_sizes()) {
+            return m_blockmap.block_containing(text_pos);
+        }
+        return text_pos / encoding_block_size;
+    }
+
+    inline size_type num_docs() const
+    {
+        return m_docmap.num_docs();
+    }
+
+    /* returns the id of the document with the given docno */
+    uint64_t doc_id(const std::string& docno) const
+    {
+        auto id = m_docmap.doc_id(docno);
+        if (id == m_docmap.num_docs()) {
+            throw std::runtime_error("Unknown docno '" + docno + "'.");
+        }
+        return id;
+    }
+
+    /* document text. only the blocks overlapping the document are decoded */
+    std::vector<uint8_t> document(uint64_t doc_id) const
+    {
+        auto range = m_docmap.document_range(doc_id);
+        std::vector<uint8_t> doc(range.second - range.first);
+        extract(range.first, doc.size(), doc.data());
+        return doc;
+    }
+
+    std::vector<uint8_t> document(uint64_t doc_id, decode_context& ctx) const
+    {
+        auto range = m_docmap.document_range(doc_id);
+        std::vector<uint8_t> doc(range.second - range.first);
+        extract(range.first, doc.size(), doc.data(), ctx);
+        return doc;
+    }
+
+    std::vector<uint8_t> document(const std::string& docno) const
+    {
+        return document(doc_id(docno));
+    }
+
+    std::vector<uint8_t> document(const std::string& docno, decode_context& ctx) const
+    {
+        return document(doc_id(docno), ctx);
+    }
+
     size_type size_in_bytes() const
     {
         return m_dict.size() + (m_factored_text.size() >> 3) + m_blockmap.size_in_bytes();
@@ -126,15 +225,38 @@ public:
         block_factor_data& bfd,
         size_t num_factors) const
     {
-        m_factor_stream.seek(offset);
-        return m_factor_coder.decode_block(m_factor_stream, bfd, num_factors);
+        return decode_factors(offset, bfd, num_factors, m_factor_stream, m_factor_coder);
+    }
+
+    template <class t_istream>
+    inline coder_size_info decode_factors(size_t offset,
+        block_factor_data& bfd,
+        size_t num_factors,
+        t_istream& factor_stream,
+        const factor_coder_type& factor_coder) const
+    {
+        factor_stream.seek(offset);
+        return factor_coder.decode_block(factor_stream, bfd, num_factors);
     }
 
     inline uint64_t decode_block(uint64_t block_id, std::vector<uint8_t>& text, block_factor_data& bfd) const
+    {
+        return decode_block(block_id, text, bfd, m_factor_stream, m_factor_coder);
+    }
+
+    /* thread-safe: only touches the state in ctx */
+    inline uint64_t decode_block(uint64_t block_id, decode_context& ctx) const
+    {
+        return decode_block(block_id, ctx.text, ctx.bfd, ctx.factor_stream, ctx.factor_coder);
+    }
+
+    template <class t_istream>
+    inline uint64_t decode_block(uint64_t block_id, std::vector<uint8_t>& text, block_factor_data& bfd,
+        t_istream& factor_stream, const factor_coder_type& factor_coder) const
     {
         auto block_start = m_blockmap.block_offset(block_id);
         auto num_factors = m_blockmap.block_factors(block_id);
-        decode_factors(block_start, bfd, num_factors);
+        decode_factors(block_start, bfd, num_factors, factor_stream, factor_coder);
 
         auto out_itr = text.begin();
         size_t literals_used = 0;
@@ -184,6 +306,141 @@ public:
         return block_content;
     }
 
+    std::vector<uint8_t>
+    block(const size_t block_id, decode_context& ctx) const
+    {
+        auto decoded_syms = decode_block(block_id, ctx);
+        return std::vector<uint8_t>(ctx.text.begin(), ctx.text.begin() + decoded_syms);
+    }
+
+    /* decoded block served from (and inserted into) the shared block cache */
+    template <class t_cache>
+    cached_block_ptr block(const size_t block_id, t_cache& cache, decode_context& ctx) const
+    {
+        return cache.get(block_id, [&] { return block(block_id, ctx); });
+    }
+
+    /* hint the kernel to read in the encoded data of the given sorted blocks */
+    void prefetch_blocks(const std::vector<uint64_t>& sorted_ids) const
+    {
+        prefetch_encoded_blocks(m_blockmap, m_factored_text, sorted_ids);
+    }
+
+    /* decode a batch of blocks in parallel, see decode_blocks_batched */
+    template <class t_callback>
+    void blocks(const std::vector<uint64_t>& ids, t_callback callback,
+        size_t num_threads = std::thread::hardware_concurrency()) const
+    {
+        decode_blocks_batched(*this, ids, callback, num_threads);
+    }
+
+    /*
+        copy text[offset,offset+len) to out and return the number of bytes written
+        (less than len if the range extends past the end of the text). only the blocks
+        overlapping the range are decoded, and within a block only the factors
+        overlapping the range are copied.
+     */
+    uint64_t extract(uint64_t offset, uint64_t len, uint8_t* out) const
+    {
+        return extract(offset, len, out, m_extract_bfd, m_extract_text, m_factor_stream, m_factor_coder);
+    }
+
+    /* thread-safe: only touches the state in ctx */
+    uint64_t extract(uint64_t offset, uint64_t len, uint8_t* out, decode_context& ctx) const
+    {
+        return extract(offset, len, out, ctx.bfd, ctx.text, ctx.factor_stream, ctx.factor_coder);
+    }
+
+    template <class t_istream>
+    uint64_t extract(uint64_t offset, uint64_t len, uint8_t* out, block_factor_data& bfd,
+        std::vector<uint8_t>& text, t_istream& factor_stream, const factor_coder_type& factor_coder) const
+    {
+        if (offset >= text_size)
+            return 0;
+        auto end = std::min(offset + len, text_size);
+        auto block_id = block_of(offset);
+        auto block_begin = block_text_start(block_id);
+        auto out_itr = out;
+        while (block_begin < end) {
+            auto block_end = block_text_start(block_id + 1);
+            auto from = std::max(offset, block_begin) - block_begin;
+            auto to = std::min(end, block_end) - block_begin;
+            out_itr += decode_block_range(block_id, from, to, out_itr, bfd, text, factor_stream, factor_coder);
+            block_id++;
+            block_begin = block_end;
+        }
+        return std::distance(out, out_itr);
+    }
+
+    /*
+        decode only bytes [from,to) of a block to out. factors ending before from are
+        skipped without touching the dictionary and decoding stops once to is reached.
+        the factor streams of the block are still entropy decoded in full, so a sampled
+        index of factor positions would save no more than the scan over the lengths.
+     */
+    uint64_t decode_block_range(uint64_t block_id, uint64_t from, uint64_t to, uint8_t* out, decode_context& ctx) const
+    {
+        return decode_block_range(block_id, from, to, out, ctx.bfd, ctx.text, ctx.factor_stream, ctx.factor_coder);
+    }
+
+    template <class t_istream>
+    uint64_t decode_block_range(uint64_t block_id, uint64_t from, uint64_t to, uint8_t* out, block_factor_data& bfd,
+        std::vector<uint8_t>& text, t_istream& factor_stream, const factor_coder_type& factor_coder) const
+    {
+        if (from >= to)
+            return 0;
+        if (t_search_local_block_context) {
+            /* local factors refer to earlier output of the block so we need all of it */
+            if (text.size() < encoding_block_size)
+                text.resize(encoding_block_size);
+            auto decoded_syms = decode_block(block_id, text, bfd, factor_stream, factor_coder);
+            to = std::min(to, decoded_syms);
+            from = std::min(from, to);
+            std::copy(text.begin() + from, text.begin() + to, out);
+            return to - from;
+        }
+
+        auto num_factors = m_blockmap.block_factors(block_id);
+        decode_factors(m_blockmap.block_offset(block_id), bfd, num_factors, factor_stream, factor_coder);
+
+        /* (1) skip the factors before the range */
+        size_t i = 0;
+        uint64_t factor_begin = 0;
+        size_t literals_used = 0;
+        size_t offsets_used = 0;
+        for (; i < num_factors; i++) {
+            const auto& factor_len = bfd.lengths[i];
+            if (factor_begin + factor_len > from)
+                break;
+            if (factor_len <= m_factor_coder.literal_threshold)
+                literals_used += factor_len;
+            else
+                offsets_used++;
+            factor_begin += factor_len;
+        }
+
+        /* (2) copy the factors overlapping the range */
+        const uint8_t* dict_ptr = m_dict.data();
+        auto out_itr = out;
+        for (; i < num_factors && factor_begin < to; i++) {
+            const auto& factor_len = bfd.lengths[i];
+            const uint8_t* src;
+            if (factor_len <= m_factor_coder.literal_threshold) {
+                src = bfd.literals.data() + literals_used;
+                literals_used += factor_len;
+            }
+            else {
+                src = dict_ptr + bfd.offsets[offsets_used];
+                offsets_used++;
+            }
+            auto copy_begin = std::max(factor_begin, from) - factor_begin;
+            auto copy_end = std::min(factor_begin + factor_len, to) - factor_begin;
+            out_itr = std::copy(src + copy_begin, src + copy_end, out_itr);
+            factor_begin += factor_len;
+        }
+        return std::distance(out, out_itr);
+    }
+
     std::pair<coder_size_info, std::vector<factor_data> >
     block_factors(const size_t block_id) const
     {
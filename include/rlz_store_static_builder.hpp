@@ -53,11 +53,49 @@ public:
         pruned_dict_size_bytes = ds;
         return *this;
     };
+    /* pack whole documents into blocks of at most block_size bytes */
+    builder& set_document_aligned_blocks(bool da)
+    {
+        document_aligned_blocks = da;
+        return *this;
+    };
+    /* mmap the dictionary instead of loading it (see static_dictionary) */
+    builder& set_mmap_dictionary(bool m)
+    {
+        mmap_dictionary = m;
+        return *this;
+    };
+    builder& set_mmap_populate(bool p)
+    {
+        mmap_populate = p;
+        return *this;
+    };
+    builder& set_mmap_hugepages(bool h)
+    {
+        mmap_hugepages = h;
+        return *this;
+    };
+    /* stream the text through read buffers of at most this many bytes
+       instead of mmapping it during factorization. 0 mmaps the text */
+    builder& set_stream_buffer_bytes(uint64_t sb)
+    {
+        stream_buffer_bytes = sb;
+        return *this;
+    };
+
+    /* encode the factors in a separate pool of this many threads while the
+       factorization threads search for the next factors. 0 encodes inline */
+    builder& set_encode_threads(uint32_t et)
+    {
+        encode_threads = et;
+        return *this;
+    };
 
     static std::string blockmap_file_name(collection& col)
     {
         return col.path + "/index/" + KEY_BLOCKMAP + "-"
-            + block_map_type::type() + "-" + factorization_strategy::type() + "-"
+            + block_map_type::type() + "-" + factorization_strategy::type()
+            + factorization_strategy::blocking_suffix(col) + "-"
             + col.param_map[PARAM_DICT_HASH] + ".sdsl";
     }
 
@@ -65,6 +103,13 @@ public:
     {
         auto start = hrclock::now();
 
+        // (0) determine the block layout
+        if (document_aligned_blocks) {
+            document_map::create_aligned_block_starts(col, block_size, rebuild);
+        }
+        col.param_map[PARAM_STREAM_BUFFER] = std::to_string(stream_buffer_bytes);
+        col.param_map[PARAM_ENCODE_THREADS] = std::to_string(encode_threads);
+
         // (1) create dictionary based on parametrized
         // dictionary creation strategy if necessary
         LOG(INFO) << "Create dictionary (" << dictionary_creation_strategy::type() << ")";
@@ -79,7 +124,7 @@ public:
 
         // (3) create factorized text using the dict
         auto factor_file_name = factorization_strategy::factor_file_name(col);
-        if (rebuild || !utils::file_exists(factor_file_name)) {
+        if (rebuild || !factorization_strategy::factorization_exists(col)) {
             factorization_strategy::template parallel_factorize<factor_storage>(col, rebuild, num_threads);
         }
         else {
@@ -98,9 +143,13 @@ public:
         }
         col.file_map[KEY_BLOCKMAP] = blockmap_file;
 
+        // (5) map documents to text ranges
+        document_map::create(col, rebuild);
+
         auto stop = hrclock::now();
         LOG(INFO) << "RLZ construction complete. time = " << duration_cast<seconds>(stop - start).count() << " sec";
 
+        set_load_options(col);
         return rlz_store_static(col);
     }
 
@@ -108,6 +157,11 @@ public:
     {
         /* make sure components exists and register them */
 
+        /* (0) check block layout */
+        if (document_aligned_blocks) {
+            document_map::register_aligned_block_starts(col, block_size);
+        }
+
         /* (1) check dict */
         auto dict_file_name = dictionary_creation_strategy::file_name(col, dict_size_bytes);
         if (!utils::file_exists(dict_file_name)) {
@@ -121,7 +175,7 @@ public:
         /* (2) check factorized text */
         auto dict_hash = col.param_map[PARAM_DICT_HASH];
         auto factor_file_name = factorization_strategy::factor_file_name(col);
-        if (!utils::file_exists(factor_file_name)) {
+        if (!factorization_strategy::factorization_exists(col)) {
             throw std::runtime_error("LOAD FAILED: Cannot find factorized text.");
         }
         else {
@@ -139,7 +193,13 @@ public:
             col.file_map[KEY_BLOCKMAP] = blockmap_file;
         }
 
+        /* (3) register the document map if there is one */
+        if (utils::file_exists(document_map::file_name(col))) {
+            col.file_map[KEY_DOCMAP] = document_map::file_name(col);
+        }
+
         /* load */
+        set_load_options(col);
         return rlz_store_static(col);
     }
 
@@ -162,6 +222,12 @@ public:
             "different factor literal coding threshold");
         static_assert(t_idx::search_local_block_context == search_local_block_context,
             "different local search strategy");
+        if (document_aligned_blocks != old.block_map.variable_block_sizes()) {
+            throw std::runtime_error("different block layout");
+        }
+        if (document_aligned_blocks) {
+            document_map::register_aligned_block_starts(col, block_size);
+        }
 
         /* (1) check dict */
         auto dict_file_name = dictionary_creation_strategy::file_name(col, dict_size_bytes);
@@ -181,13 +247,27 @@ public:
         auto factor_file_name = factorization_strategy::factor_file_name(col);
         auto boffsets_file_name = factorization_strategy::boffsets_file_name(col);
         auto bfactors_file_name = factorization_strategy::bfactors_file_name(col);
-        if (rebuild || !utils::file_exists(factor_file_name)) {
+        if (rebuild || !factorization_strategy::factorization_exists(col)) {
+            /* trainable coders are trained on the factors of sample blocks of the old store */
+            if (coder::is_trainable<t_factor_coder>::value) {
+                size_t num_blocks = old.block_map.num_blocks();
+                size_t num_samples = std::min(num_blocks, (size_t)256);
+                std::vector<block_factor_data> samples;
+                for (size_t i = 0; i < num_samples; i++) {
+                    auto block_id = i * num_blocks / num_samples;
+                    old.decode_factors(old.block_map.block_offset(block_id), bfd, old.block_map.block_factors(block_id));
+                    samples.push_back(bfd.compact());
+                }
+                bfd.reset();
+                factorization_strategy::train_coder(col, samples);
+            }
             auto factor_buf = sdsl::write_out_buffer<1>::create(factor_file_name);
             auto block_offsets = sdsl::write_out_buffer<0>::create(boffsets_file_name);
             auto block_factors = sdsl::write_out_buffer<0>::create(bfactors_file_name);
             bit_ostream<sdsl::int_vector_mapper<1> > factor_stream(factor_buf);
             size_t cur_block_offset = itr.block_id;
             t_factor_coder coder;
+            factorization_strategy::load_coder_models(col, coder, true);
             auto num_blocks = old.block_map.num_blocks();
             auto num_blocks10p = (uint64_t)(num_blocks * 0.1);
 
@@ -235,14 +315,30 @@ public:
             sdsl::store_to_file(tmp, blockmap_file);
         }
         col.file_map[KEY_BLOCKMAP] = blockmap_file;
+        document_map::create(col, rebuild);
         auto stop = hrclock::now();
         LOG(INFO) << "RLZ factor reencode complete. time = " << duration_cast<seconds>(stop - start).count() << " sec";
+        set_load_options(col);
         return rlz_store_static(col);
     }
 
+private:
+    void set_load_options(collection& col) const
+    {
+        col.param_map[PARAM_MMAP_DICT] = mmap_dictionary ? "1" : "0";
+        col.param_map[PARAM_MMAP_POPULATE] = mmap_populate ? "1" : "0";
+        col.param_map[PARAM_MMAP_HUGEPAGES] = mmap_hugepages ? "1" : "0";
+    }
+
 private:
     bool rebuild = false;
     uint32_t num_threads = 1;
     uint64_t dict_size_bytes = 0;
     uint64_t pruned_dict_size_bytes = 0;
+    bool document_aligned_blocks = false;
+    bool mmap_dictionary = false;
+    bool mmap_populate = false;
+    bool mmap_hugepages = false;
+    uint64_t stream_buffer_bytes = 0;
+    uint32_t encode_threads = 0;
 };
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <chrono>
+#include <random>
 
 #include "utils.hpp"
 #include "factor_storage.hpp"
@@ -68,6 +69,42 @@ void benchmark_text_decoding(const t_idx& idx)
     LOG(INFO) << "text checksum = " << checksum;
 }
 
+/* uniformly random block ids with a fixed seed so runs are comparable */
+inline std::vector<uint64_t> random_block_ids(uint64_t num_blocks, size_t num_queries)
+{
+    std::vector<uint64_t> ids(num_queries);
+    std::mt19937 gen(4711);
+    std::uniform_int_distribution<uint64_t> dis(0, num_blocks - 1);
+    for (auto& id : ids)
+        id = dis(gen);
+    return ids;
+}
+
+template <class t_idx>
+void benchmark_random_block_access(const t_idx& idx, size_t num_queries = 10000)
+{
+    auto ids = random_block_ids(idx.block_map.num_blocks(), num_queries);
+    uint64_t checksum = 0;
+    auto start = hrclock::now();
+    for (const auto& id : ids) {
+        auto block = idx.block(id);
+        checksum += block.size();
+    }
+    auto stop = hrclock::now();
+    auto us = duration_cast<microseconds>(stop - start).count();
+    LOG(INFO) << "random block decode = " << (double)us / num_queries << " us per block (checksum " << checksum << ")";
+}
+
+/* build or load a store with the dictionary size and threads given on the command line */
+template <class t_idx>
+t_idx build_or_load_store(collection& col, const utils::cmdargs_t& args)
+{
+    return typename t_idx::builder{}
+        .set_threads(args.threads)
+        .set_dict_size(args.dict_size_in_bytes)
+        .build_or_load(col);
+}
+
 template <class t_idx>
 void print_compressed_size(collection& col, t_idx& idx)
 {
@@ -89,23 +126,25 @@ bool verify_index(collection& col, t_idx& idx)
 {
     LOG(INFO) << "Verify that factorization is correct.";
     sdsl::read_only_mapper<8> text(col.file_map[KEY_TEXT]);
-    auto num_blocks = text.size() / t_idx::block_size;
+    auto num_blocks = idx.block_map.num_blocks();
 
     bool error = false;
     for (size_t i = 0; i < num_blocks; i++) {
         auto block_content = idx.block(i);
-        auto block_start = i * t_idx::block_size;
-        if (block_content.size() != t_idx::block_size) {
+        auto block_start = idx.block_text_start(i);
+        auto block_size = idx.block_text_start(i + 1) - block_start;
+        if (block_content.size() != block_size) {
             error = true;
             LOG_N_TIMES(100, ERROR) << "Error in block " << i
                                     << " block size = " << block_content.size()
-                                    << " encoding block_size = " << t_idx::block_size;
+                                    << " expected block size = " << block_size;
+            continue;
         }
         auto eq = std::equal(block_content.begin(), block_content.end(), text.begin() + block_start);
         if (!eq) {
             error = true;
             LOG(ERROR) << "BLOCK " << i << " NOT EQUAL";
-            for (size_t j = 0; j < t_idx::block_size; j++) {
+            for (size_t j = 0; j < block_size; j++) {
                 if (text[block_start + j] != block_content[j]) {
                     LOG_N_TIMES(100, ERROR) << "Error at pos " << j << "(" << block_start + j << ") should be '"
                                             << (int)text[block_start + j] << "' is '" << (int)block_content[j] << "'";
@@ -114,27 +153,9 @@ bool verify_index(collection& col, t_idx& idx)
             exit(EXIT_FAILURE);
         }
     }
-    auto left = text.size() % t_idx::block_size;
-    if (left) {
-        auto block_content = idx.block(num_blocks);
-        auto block_start = num_blocks * t_idx::block_size;
-        if (block_content.size() != left) {
-            error = true;
-            LOG(ERROR) << "Error in  LAST block "
-                       << " block size = " << block_content.size()
-                       << " left  = " << left;
-        }
-        auto eq = std::equal(block_content.begin(), block_content.end(), text.begin() + block_start);
-        if (!eq) {
-            error = true;
-            LOG(ERROR) << "LAST BLOCK IS NOT EQUAL";
-            for (size_t j = 0; j < left; j++) {
-                if (text[block_start + j] != block_content[j]) {
-                    LOG_N_TIMES(100, ERROR) << "Error at pos " << j << "(" << block_start + j << ") should be '"
-                                            << (int)text[block_start + j] << "' is '" << (int)block_content[j] << "'";
-                }
-            }
-        }
+    if (idx.block_text_start(num_blocks) != text.size()) {
+        error = true;
+        LOG(ERROR) << "Blocks cover " << idx.block_text_start(num_blocks) << " of " << text.size() << " bytes";
     }
     if (!error) {
         LOG(INFO) << "SUCCESS! Text sucessfully recovered.";
@@ -143,6 +164,16 @@ bool verify_index(collection& col, t_idx& idx)
     return false;
 }
 
+/* size, correctness, sequential and random decoding of a built store */
+template <class t_idx>
+void benchmark_store(collection& col, t_idx& idx)
+{
+    print_compressed_size(col, idx);
+    verify_index(col, idx);
+    benchmark_text_decoding(idx);
+    benchmark_random_block_access(idx);
+}
+
 template <class t_idx>
 void output_stats(t_idx& idx, std::string name = std::string())
 {
@@ -158,9 +189,9 @@ void output_stats(t_idx& idx, std::string name = std::string())
     /* compute blocksize stats */
     {
         std::vector<uint64_t> block_sizes(idx.block_map.num_blocks());
-        std::adjacent_difference(idx.block_map.m_block_offsets.begin(),
-            idx.block_map.m_block_offsets.end(),
-            block_sizes.begin());
+        for (size_t i = 0; i < block_sizes.size(); i++)
+            block_sizes[i] = idx.block_map.block_offset(i);
+        std::adjacent_difference(block_sizes.begin(), block_sizes.end(), block_sizes.begin());
         std::sort(block_sizes.begin(), block_sizes.end());
         auto block_size_min = block_sizes[1] / 8; // bits to bytes
         auto block_size_max = block_sizes.back() / 8; // bits to bytes
@@ -181,7 +212,8 @@ void output_stats(t_idx& idx, std::string name = std::string())
     /* compute num factor stats */
     {
         std::vector<uint64_t> block_factors(idx.block_map.num_blocks());
-        std::copy(idx.block_map.m_block_factors.begin(), idx.block_map.m_block_factors.end(), block_factors.begin());
+        for (size_t i = 0; i < block_factors.size(); i++)
+            block_factors[i] = idx.block_map.block_factors(i);
         std::sort(block_factors.begin(), block_factors.end());
         auto block_factors_min = block_factors.front() / 8; // bits to bytes
         auto block_factors_max = block_factors.back() / 8; // bits to bytes
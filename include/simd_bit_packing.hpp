@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+    bit packing of blocks of 128 32-bit integers in the vertical layout of
+    the SIMD-BP128 scheme of Lemire and Boytsov: value i is stored in lane
+    i % 4 of a sequence of 128-bit words, so four values are packed and
+    unpacked with one shift per step. a block with b bits per value takes
+    exactly 16 * b bytes. without SSE2 the same layout is produced with
+    scalar code.
+ */
+namespace simd_bit_packing {
+
+const size_t block_len = 128;
+
+inline uint32_t bits(uint32_t x)
+{
+    return x ? 32 - __builtin_clz(x) : 0;
+}
+
+/* the smallest b with all in[0..block_len) < 2^b */
+inline uint32_t max_bits(const uint32_t* in)
+{
+    uint32_t acc = 0;
+    for (size_t i = 0; i < block_len; i++)
+        acc |= in[i];
+    return bits(acc);
+}
+
+/* packs the low b bits of in[0..block_len) into out[0..16*b) */
+inline void pack(const uint32_t* in, uint8_t* out, uint32_t b)
+{
+    if (b == 0)
+        return;
+    if (b == 32) {
+        std::memcpy(out, in, block_len * sizeof(uint32_t));
+        return;
+    }
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi32((1U << b) - 1);
+    __m128i* outw = (__m128i*)out;
+    __m128i acc = _mm_setzero_si128();
+    uint32_t shift = 0;
+    for (size_t k = 0; k < block_len / 4; k++) {
+        __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + 4 * k)), mask);
+        acc = _mm_or_si128(acc, _mm_sll_epi32(v, _mm_cvtsi32_si128(shift)));
+        shift += b;
+        if (shift >= 32) {
+            _mm_storeu_si128(outw++, acc);
+            shift -= 32;
+            acc = shift ? _mm_srl_epi32(v, _mm_cvtsi32_si128(b - shift)) : _mm_setzero_si128();
+        }
+    }
+#else
+    const uint32_t mask = (1U << b) - 1;
+    for (size_t lane = 0; lane < 4; lane++) {
+        uint32_t acc = 0;
+        uint32_t shift = 0;
+        size_t w = 0;
+        for (size_t k = 0; k < block_len / 4; k++) {
+            uint32_t v = in[4 * k + lane] & mask;
+            acc |= v << shift;
+            shift += b;
+            if (shift >= 32) {
+                std::memcpy(out + 16 * w++ + 4 * lane, &acc, 4);
+                shift -= 32;
+                acc = shift ? v >> (b - shift) : 0;
+            }
+        }
+    }
+#endif
+}
+
+/* unpacks block_len values of b bits from in[0..16*b) */
+inline void unpack(const uint8_t* in, uint32_t* out, uint32_t b)
+{
+    if (b == 0) {
+        std::memset(out, 0, block_len * sizeof(uint32_t));
+        return;
+    }
+    if (b == 32) {
+        std::memcpy(out, in, block_len * sizeof(uint32_t));
+        return;
+    }
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi32((1U << b) - 1);
+    const __m128i* inw = (const __m128i*)in;
+    __m128i w = _mm_loadu_si128(inw++);
+    uint32_t shift = 0;
+    for (size_t k = 0; k < block_len / 4; k++) {
+        __m128i v = _mm_srl_epi32(w, _mm_cvtsi32_si128(shift));
+        shift += b;
+        if (shift > 32) { // the value continues in the next word
+            shift -= 32;
+            w = _mm_loadu_si128(inw++);
+            v = _mm_or_si128(v, _mm_sll_epi32(w, _mm_cvtsi32_si128(b - shift)));
+        }
+        else if (shift == 32 && k + 1 < block_len / 4) {
+            shift = 0;
+            w = _mm_loadu_si128(inw++);
+        }
+        _mm_storeu_si128((__m128i*)(out + 4 * k), _mm_and_si128(v, mask));
+    }
+#else
+    const uint32_t mask = (1U << b) - 1;
+    for (size_t lane = 0; lane < 4; lane++) {
+        size_t wi = 0;
+        uint32_t w;
+        std::memcpy(&w, in + 16 * wi++ + 4 * lane, 4);
+        uint32_t shift = 0;
+        for (size_t k = 0; k < block_len / 4; k++) {
+            uint32_t v = shift < 32 ? w >> shift : 0;
+            shift += b;
+            if (shift > 32) {
+                shift -= 32;
+                std::memcpy(&w, in + 16 * wi++ + 4 * lane, 4);
+                v |= w << (b - shift);
+            }
+            else if (shift == 32 && k + 1 < block_len / 4) {
+                shift = 0;
+                std::memcpy(&w, in + 16 * wi++ + 4 * lane, 4);
+            }
+            out[4 * k + lane] = v & mask;
+        }
+    }
+#endif
+}
+
+/* vbyte on byte pointers, in the format of coder::vbyte */
+inline void put_vbyte(uint8_t*& out, uint32_t x)
+{
+    while (x >= 128) {
+        *out++ = (x & 0x7F) | 0x80;
+        x >>= 7;
+    }
+    *out++ = x;
+}
+
+inline uint32_t get_vbyte(const uint8_t*& in)
+{
+    uint32_t x = 0;
+    uint32_t shift = 0;
+    uint8_t w;
+    do {
+        w = *in++;
+        x |= (uint32_t)(w & 0x7F) << shift;
+        shift += 7;
+    } while (w & 0x80);
+    return x;
+}
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "utils.hpp"
+#include "collection.hpp"
+
+#include <sdsl/int_vector.hpp>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*
+    the dictionary of an rlz store. by default it is loaded into a private heap
+    copy. if PARAM_MMAP_DICT is set the sdsl int_vector<8> file is instead mapped
+    read-only, so the store opens without reading the file and all processes
+    using the same dictionary share its pages in the page cache.
+    PARAM_MMAP_POPULATE prefaults the mapping (MAP_POPULATE) and
+    PARAM_MMAP_HUGEPAGES asks for transparent huge pages (MADV_HUGEPAGE), which
+    the kernel only honours for file mappings on some file systems.
+ */
+class static_dictionary {
+public:
+    using size_type = uint64_t;
+    using const_iterator = const uint8_t*;
+
+private:
+    sdsl::int_vector<8> m_loaded;
+    const uint8_t* m_data = nullptr;
+    size_type m_size = 0;
+    void* m_mapping = nullptr;
+    size_t m_mapping_bytes = 0;
+
+    void unmap()
+    {
+        if (m_mapping != nullptr) {
+            munmap(m_mapping, m_mapping_bytes);
+            m_mapping = nullptr;
+            m_mapping_bytes = 0;
+        }
+    }
+
+    void map_file(const std::string& file_name, bool populate, bool huge_pages)
+    {
+        int fd = open(file_name.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open dictionary file '" + file_name + "'.");
+        }
+        struct stat fs;
+        if (fstat(fd, &fs) != 0 || fs.st_size < (off_t)sizeof(uint64_t)) {
+            close(fd);
+            throw std::runtime_error("Invalid dictionary file '" + file_name + "'.");
+        }
+        int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+        if (populate)
+            flags |= MAP_POPULATE;
+#endif
+        m_mapping_bytes = fs.st_size;
+        m_mapping = mmap(nullptr, m_mapping_bytes, PROT_READ, flags, fd, 0);
+        close(fd);
+        if (m_mapping == MAP_FAILED) {
+            m_mapping = nullptr;
+            throw std::runtime_error("Cannot mmap dictionary file '" + file_name + "'.");
+        }
+#ifdef MADV_HUGEPAGE
+        if (huge_pages)
+            madvise(m_mapping, m_mapping_bytes, MADV_HUGEPAGE);
+#endif
+        /* int_vector<8> files start with the size in bits */
+        const uint64_t* header = (const uint64_t*)m_mapping;
+        m_size = header[0] / 8;
+        m_data = (const uint8_t*)(header + 1);
+        if (sizeof(uint64_t) + m_size > m_mapping_bytes) {
+            unmap();
+            throw std::runtime_error("Truncated dictionary file '" + file_name + "'.");
+        }
+    }
+
+    static bool param_set(collection& col, const std::string& param)
+    {
+        auto itr = col.param_map.find(param);
+        return itr != col.param_map.end() && itr->second == "1";
+    }
+
+public:
+    static_dictionary() = default;
+    static_dictionary(const static_dictionary&) = delete;
+    static_dictionary& operator=(const static_dictionary&) = delete;
+    static_dictionary(static_dictionary&& sd)
+    {
+        *this = std::move(sd);
+    }
+    static_dictionary& operator=(static_dictionary&& sd)
+    {
+        if (this != &sd) {
+            unmap();
+            m_loaded = std::move(sd.m_loaded);
+            m_size = sd.m_size;
+            m_mapping = sd.m_mapping;
+            m_mapping_bytes = sd.m_mapping_bytes;
+            m_data = (m_mapping != nullptr) ? sd.m_data : (const uint8_t*)m_loaded.data();
+            sd.m_mapping = nullptr;
+            sd.m_mapping_bytes = 0;
+            sd.m_data = nullptr;
+            sd.m_size = 0;
+        }
+        return *this;
+    }
+    ~static_dictionary()
+    {
+        unmap();
+    }
+
+    static_dictionary(const std::string& file_name, bool mmap_file, bool populate = false, bool huge_pages = false)
+    {
+        if (mmap_file) {
+            map_file(file_name, populate, huge_pages);
+        }
+        else {
+            sdsl::load_from_file(m_loaded, file_name);
+            m_data = (const uint8_t*)m_loaded.data();
+            m_size = m_loaded.size();
+        }
+    }
+
+    static_dictionary(collection& col)
+        : static_dictionary(col.file_map[KEY_DICT],
+              param_set(col, PARAM_MMAP_DICT),
+              param_set(col, PARAM_MMAP_POPULATE),
+              param_set(col, PARAM_MMAP_HUGEPAGES))
+    {
+    }
+
+    inline bool is_mapped() const
+    {
+        return m_mapping != nullptr;
+    }
+    inline size_type size() const
+    {
+        return m_size;
+    }
+    inline const uint8_t* data() const
+    {
+        return m_data;
+    }
+    inline const_iterator begin() const
+    {
+        return m_data;
+    }
+    inline const_iterator end() const
+    {
+        return m_data + m_size;
+    }
+    inline uint8_t operator[](size_type i) const
+    {
+        return m_data[i];
+    }
+};
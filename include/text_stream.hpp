@@ -0,0 +1,86 @@
+#pragma once
+
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/* a contiguous run of blocks [first_block,last_block) of the text read into memory */
+struct text_chunk {
+    size_t id = 0;
+    size_t first_block = 0;
+    size_t last_block = 0;
+    uint64_t text_offset = 0;
+    std::vector<uint8_t> data;
+};
+
+/*
+    sequential reader for an sdsl int_vector<8> text file. ranges are read with
+    pread into caller owned buffers and the kernel is told to drop the read
+    pages from the page cache, so a build streaming over a text larger than RAM
+    does not evict the dictionary and index pages.
+ */
+class text_stream_reader {
+private:
+    int m_fd = -1;
+    uint64_t m_size = 0;
+    std::string m_file_name;
+
+    static const off_t header_bytes = sizeof(uint64_t);
+
+public:
+    text_stream_reader(const std::string& file_name)
+        : m_file_name(file_name)
+    {
+        m_fd = open(file_name.c_str(), O_RDONLY);
+        if (m_fd < 0) {
+            throw std::runtime_error("Cannot open text file '" + file_name + "'.");
+        }
+        uint64_t size_in_bits = 0;
+        if (pread(m_fd, &size_in_bits, sizeof(size_in_bits), 0) != sizeof(size_in_bits)) {
+            close(m_fd);
+            throw std::runtime_error("Cannot read header of text file '" + file_name + "'.");
+        }
+        m_size = size_in_bits / 8;
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    }
+    text_stream_reader(const text_stream_reader&) = delete;
+    text_stream_reader& operator=(const text_stream_reader&) = delete;
+    ~text_stream_reader()
+    {
+        if (m_fd >= 0)
+            close(m_fd);
+    }
+
+    /* number of text symbols */
+    uint64_t size() const
+    {
+        return m_size;
+    }
+
+    /* read text[offset,offset+len) into buf */
+    void read(uint64_t offset, uint64_t len, std::vector<uint8_t>& buf)
+    {
+        buf.resize(len);
+        uint64_t done = 0;
+        while (done < len) {
+            auto ret = pread(m_fd, buf.data() + done, len - done, header_bytes + offset + done);
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret <= 0) {
+                throw std::runtime_error("Error reading text file '" + m_file_name + "': " + std::strerror(errno));
+            }
+            done += ret;
+        }
+#ifdef POSIX_FADV_DONTNEED
+        posix_fadvise(m_fd, header_bytes + offset, len, POSIX_FADV_DONTNEED);
+#endif
+    }
+};
@@ -8,6 +8,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <cstdio>
 #include <chrono>
@@ -123,6 +124,15 @@ void remove_all_files_in_dir(std::string dir)
     }
 }
 
+/* ask the kernel to read in the pages of a mmapped range before we touch them */
+void advise_willneed(const void* ptr, size_t bytes)
+{
+    static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    auto begin = (uintptr_t)ptr & ~(page_size - 1);
+    auto end = (uintptr_t)ptr + bytes;
+    madvise((void*)begin, end - begin, MADV_WILLNEED);
+}
+
 template <class t_itr>
 std::string safe_print(t_itr itr, t_itr end)
 {
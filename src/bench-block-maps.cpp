@@ -0,0 +1,84 @@
+#define ELPP_THREAD_SAFE
+#define ELPP_STL_LOGGING
+
+#include "utils.hpp"
+#include "collection.hpp"
+#include "rlz_utils.hpp"
+
+#include "indexes.hpp"
+
+#include "logging.hpp"
+INITIALIZE_EASYLOGGINGPP
+
+template <class t_block_map>
+void bench_block_map(collection& col, const std::vector<uint64_t>& ids, std::vector<uint64_t>& expected)
+{
+    t_block_map bm(col);
+    LOG(INFO) << t_block_map::type() << " num_blocks = " << bm.num_blocks();
+    LOG(INFO) << t_block_map::type() << " size = " << bm.size_in_bytes() << " bytes ("
+              << (double)bm.size_in_bytes() * 8 / bm.num_blocks() << " bits per block)";
+
+    /* sequential access */
+    {
+        auto start = hrclock::now();
+        uint64_t checksum = 0;
+        for (size_t i = 0; i < bm.num_blocks(); i++) {
+            checksum += bm.block_offset(i) + bm.block_factors(i);
+        }
+        auto stop = hrclock::now();
+        auto ns = duration_cast<nanoseconds>(stop - start).count();
+        LOG(INFO) << t_block_map::type() << " sequential = " << (double)ns / bm.num_blocks()
+                  << " ns per block (checksum " << checksum << ")";
+    }
+
+    /* random access */
+    {
+        std::vector<uint64_t> result(ids.size());
+        auto start = hrclock::now();
+        for (size_t i = 0; i < ids.size(); i++) {
+            result[i] = bm.block_offset(ids[i]) + bm.block_factors(ids[i]);
+        }
+        auto stop = hrclock::now();
+        auto ns = duration_cast<nanoseconds>(stop - start).count();
+        LOG(INFO) << t_block_map::type() << " random = " << (double)ns / ids.size() << " ns per block";
+        if (expected.empty()) {
+            expected = result;
+        }
+        else if (expected != result) {
+            LOG(ERROR) << t_block_map::type() << " returns different offsets/counts";
+        }
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    setup_logger(argc, argv);
+
+    /* parse command line */
+    LOG(INFO) << "Parsing command line arguments";
+    auto args = utils::parse_args(argc, argv);
+
+    /* parse the collection */
+    LOG(INFO) << "Parsing collection directory " << args.collection_dir;
+    collection col(args.collection_dir);
+
+    /* make sure the factorization exists and the block files are registered */
+    const uint32_t factorization_blocksize = 64 * 1024;
+    auto rlz_store = build_or_load_store<rlz_store_static<dict_uniform_sample_budget<default_dict_sample_block_size>,
+        dict_prune_none,
+        dict_index_csa<>,
+        factorization_blocksize,
+        false,
+        factor_select_first,
+        factor_coder_blocked<3, coder::zlib<9>, coder::zlib<9>, coder::zlib<9> >,
+        block_map_uncompressed> >(col, args);
+
+    auto ids = random_block_ids(rlz_store.block_map.num_blocks(), 10000000);
+
+    std::vector<uint64_t> expected;
+    bench_block_map<block_map_uncompressed>(col, ids, expected);
+    bench_block_map<block_map_ef>(col, ids, expected);
+    bench_block_map<block_map_mapped>(col, ids, expected);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,74 @@
+#define ELPP_THREAD_SAFE
+#define ELPP_STL_LOGGING
+
+#include "utils.hpp"
+#include "collection.hpp"
+#include "rlz_utils.hpp"
+
+#include "indexes.hpp"
+
+#include "logging.hpp"
+INITIALIZE_EASYLOGGINGPP
+
+/* factorize a prefix of the text with each dictionary index and report
+   construction time, factorization speed and the average factor length.
+   shorter factors of the approximate hash index show up as a lower average */
+const uint32_t factorization_blocksize = 64 * 1024;
+const uint64_t max_bench_bytes = 64 * 1024 * 1024;
+using bench_coder_type = factor_coder_blocked<3, coder::fixed<32>, coder::aligned_fixed<uint32_t>, coder::vbyte>;
+
+template <class t_index>
+void bench_dict_index(const std::string& name, const sdsl::int_vector<8>& dict, const uint8_t* text, uint64_t n)
+{
+    using factorizor_type = factorizor<factorization_blocksize, false, t_index, factor_select_first, bench_coder_type>;
+    auto start = hrclock::now();
+    t_index idx(dict);
+    auto stop = hrclock::now();
+    LOG(INFO) << name << " construction = " << duration_cast<milliseconds>(stop - start).count() / 1000.0 << " sec";
+
+    bench_coder_type coder;
+    typename factorizor_type::local_context_type local_ctx;
+    factor_batcher fb(factorization_blocksize);
+    uint64_t num_factors = 0;
+    start = hrclock::now();
+    for (uint64_t block_start = 0; block_start < n; block_start += factorization_blocksize) {
+        auto block_end = std::min(block_start + factorization_blocksize, n);
+        factorizor_type::factorize_block(fb, coder, idx, text + block_start, text + block_end, local_ctx);
+        for (const auto& bfd : fb.take())
+            num_factors += bfd.num_factors;
+    }
+    stop = hrclock::now();
+    auto seconds = duration_cast<milliseconds>(stop - start).count() / 1000.0;
+    LOG(INFO) << name << " factorization = " << (n / (1024.0 * 1024.0)) / seconds << " MB/s";
+    LOG(INFO) << name << " factors = " << num_factors << " (avg len " << (double)n / num_factors << ")";
+}
+
+int main(int argc, const char* argv[])
+{
+    setup_logger(argc, argv);
+
+    /* parse command line */
+    LOG(INFO) << "Parsing command line arguments";
+    auto args = utils::parse_args(argc, argv);
+
+    /* parse the collection */
+    LOG(INFO) << "Parsing collection directory " << args.collection_dir;
+    collection col(args.collection_dir);
+
+    dict_uniform_sample_budget<default_dict_sample_block_size>::create(col, false, args.dict_size_in_bytes);
+    sdsl::int_vector<8> dict;
+    sdsl::load_from_file(dict, col.file_map[KEY_DICT]);
+
+    sdsl::read_only_mapper<8> text(col.file_map[KEY_TEXT]);
+    const uint8_t* text_ptr = (const uint8_t*)text.data();
+    uint64_t n = std::min((uint64_t)text.size(), max_bench_bytes);
+    LOG(INFO) << "Factorize the first " << n / (1024 * 1024) << " MiB of the text";
+
+    bench_dict_index<dict_index_sa>("dict_index_sa", dict, text_ptr, n);
+    bench_dict_index<dict_index_csa<> >("dict_index_csa", dict, text_ptr, n);
+    bench_dict_index<dict_index_hash<22, 0> >("dict_index_hash-exact", dict, text_ptr, n);
+    bench_dict_index<dict_index_hash<22, 16> >("dict_index_hash-c=16", dict, text_ptr, n);
+    bench_dict_index<dict_index_hash<> >("dict_index_hash-default", dict, text_ptr, n);
+
+    return EXIT_SUCCESS;
+}
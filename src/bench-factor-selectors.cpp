@@ -0,0 +1,59 @@
+#define ELPP_THREAD_SAFE
+#define ELPP_STL_LOGGING
+
+#include "utils.hpp"
+#include "collection.hpp"
+#include "rlz_utils.hpp"
+
+#include "indexes.hpp"
+
+#include "logging.hpp"
+INITIALIZE_EASYLOGGINGPP
+
+/* build (or load) the same store with different factor selectors and
+   report size, factorization time and decoding speed */
+template <class t_factor_selector, class t_factor_coder>
+void bench_factor_selector(collection& col, const utils::cmdargs_t& args)
+{
+    const uint32_t factorization_blocksize = 64 * 1024;
+    auto start = hrclock::now();
+    auto rlz_store = build_or_load_store<rlz_store_static<dict_uniform_sample_budget<default_dict_sample_block_size>,
+        dict_prune_none,
+        dict_index_csa<>,
+        factorization_blocksize,
+        false,
+        t_factor_selector,
+        t_factor_coder,
+        block_map_uncompressed> >(col, args);
+    auto stop = hrclock::now();
+    LOG(INFO) << "factor selector = " << t_factor_selector::type() << " coder = " << t_factor_coder::type();
+    LOG(INFO) << "build or load time = " << duration_cast<milliseconds>(stop - start).count() / 1000.0 << " sec";
+    benchmark_store(col, rlz_store);
+}
+
+template <class t_factor_coder>
+void bench_factor_selectors(collection& col, const utils::cmdargs_t& args)
+{
+    bench_factor_selector<factor_select_first, t_factor_coder>(col, args);
+    bench_factor_selector<factor_select_last, t_factor_coder>(col, args);
+    bench_factor_selector<factor_select_nearest<16>, t_factor_coder>(col, args);
+    bench_factor_selector<factor_select_nearest<64>, t_factor_coder>(col, args);
+}
+
+int main(int argc, const char* argv[])
+{
+    setup_logger(argc, argv);
+
+    /* parse command line */
+    LOG(INFO) << "Parsing command line arguments";
+    auto args = utils::parse_args(argc, argv);
+
+    /* parse the collection */
+    LOG(INFO) << "Parsing collection directory " << args.collection_dir;
+    collection col(args.collection_dir);
+
+    bench_factor_selectors<factor_coder_blocked<3, coder::fixed<32>, coder::aligned_fixed<uint32_t>, coder::vbyte> >(col, args);
+    bench_factor_selectors<factor_coder_blocked<3, coder::zlib<9>, coder::zlib<9>, coder::zlib<9> > >(col, args);
+
+    return EXIT_SUCCESS;
+}
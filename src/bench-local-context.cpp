@@ -0,0 +1,50 @@
+#define ELPP_THREAD_SAFE
+#define ELPP_STL_LOGGING
+
+#include "utils.hpp"
+#include "collection.hpp"
+#include "rlz_utils.hpp"
+
+#include "indexes.hpp"
+
+#include "logging.hpp"
+INITIALIZE_EASYLOGGINGPP
+
+/* build (or load) the same store with and without local block context
+   search and report size, factorization time and decoding speed */
+template <bool t_search_local_block_context>
+void bench_local_context(collection& col, const utils::cmdargs_t& args)
+{
+    const uint32_t factorization_blocksize = 64 * 1024;
+    auto start = hrclock::now();
+    auto rlz_store = build_or_load_store<rlz_store_static<dict_uniform_sample_budget<default_dict_sample_block_size>,
+        dict_prune_none,
+        dict_index_csa<>,
+        factorization_blocksize,
+        t_search_local_block_context,
+        factor_select_first,
+        factor_coder_blocked<3, coder::zlib<9>, coder::zlib<9>, coder::zlib<9> >,
+        block_map_uncompressed> >(col, args);
+    auto stop = hrclock::now();
+    LOG(INFO) << "local block context = " << t_search_local_block_context;
+    LOG(INFO) << "build or load time = " << duration_cast<milliseconds>(stop - start).count() / 1000.0 << " sec";
+    benchmark_store(col, rlz_store);
+}
+
+int main(int argc, const char* argv[])
+{
+    setup_logger(argc, argv);
+
+    /* parse command line */
+    LOG(INFO) << "Parsing command line arguments";
+    auto args = utils::parse_args(argc, argv);
+
+    /* parse the collection */
+    LOG(INFO) << "Parsing collection directory " << args.collection_dir;
+    collection col(args.collection_dir);
+
+    bench_local_context<false>(col, args);
+    bench_local_context<true>(col, args);
+
+    return EXIT_SUCCESS;
+}
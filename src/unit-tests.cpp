@@ -2,8 +2,21 @@
 #include "sdsl/int_vector.hpp"
 #include "bit_streams.hpp"
 #include "bit_coders.hpp"
+#include "block_cache.hpp"
+#include "block_batch.hpp"
+#include "concurrent_queue.hpp"
+#include "factor_coder.hpp"
+#include "factor_storage.hpp"
+#include "document_map.hpp"
+#include "factorizor.hpp"
+#include "dict_indexes.hpp"
+#include "indexes.hpp"
+#include "local_block_context.hpp"
+#include "match_length.hpp"
+#include <cstdio>
 #include <functional>
 #include <random>
+#include <sstream>
 
 #include "utils.hpp"
 
@@ -41,6 +54,52 @@ TEST(bit_stream, vbyte)
     }
 }
 
+TEST(bit_stream, vbyte_unaligned)
+{
+    size_t n = 20;
+    std::mt19937 gen(4711);
+    std::uniform_int_distribution<uint64_t> len_dis(1, 10000);
+
+    for (size_t i = 0; i < n; i++) {
+        size_t len = len_dis(gen);
+        uint32_t width = 1 + gen() % 32;
+        std::vector<uint32_t> A(len);
+        for (size_t j = 0; j < len; j++)
+            A[j] = gen() & ((1ULL << (1 + gen() % width)) - 1);
+        coder::vbyte c;
+        sdsl::bit_vector bv;
+        sdsl::bit_vector expected;
+        {
+            bit_ostream<sdsl::bit_vector> os(bv);
+            os.put_int(4711, 13);
+            c.encode(os, A.data(), len);
+        }
+        {
+            // the format written one byte at a time
+            bit_ostream<sdsl::bit_vector> os(expected);
+            os.put_int(4711, 13);
+            for (auto x : A) {
+                while (x >= 128) {
+                    os.put_int((x & 0x7F) | 0x80, 8);
+                    x >>= 7;
+                }
+                os.put_int(x, 8);
+            }
+        }
+        ASSERT_TRUE(bv == expected);
+        std::vector<uint32_t> B(len);
+        {
+            bit_istream<sdsl::bit_vector> is(bv);
+            ASSERT_EQ(is.get_int(13), 4711ULL);
+            c.decode(is, B.data(), len);
+            ASSERT_EQ(is.tellg(), bv.size());
+        }
+        for (size_t j = 0; j < len; j++) {
+            ASSERT_EQ(B[j], A[j]);
+        }
+    }
+}
+
 TEST(bit_stream, fixed)
 {
     size_t n = 20;
@@ -72,6 +131,49 @@ TEST(bit_stream, fixed)
     }
 }
 
+template <uint8_t t_width>
+void fixed_roundtrip_unaligned()
+{
+    std::mt19937_64 gen(t_width);
+    for (size_t i = 0; i < 20; i++) {
+        size_t len = gen() % 1000;
+        uint8_t prefix = gen() % 64;
+        std::vector<uint64_t> A(len);
+        for (auto& x : A)
+            x = t_width == 64 ? gen() : gen() & ((1ULL << (t_width & 63)) - 1);
+        coder::fixed<t_width> c;
+        sdsl::bit_vector bv;
+        {
+            bit_ostream<sdsl::bit_vector> os(bv);
+            os.put_int(4711, prefix);
+            c.encode(os, A.data(), len);
+        }
+        std::vector<uint64_t> B(len);
+        {
+            bit_istream<sdsl::bit_vector> is(bv);
+            is.skip(prefix);
+            c.decode(is, B.data(), len);
+            ASSERT_EQ(is.tellg(), bv.size());
+        }
+        for (size_t j = 0; j < len; j++) {
+            ASSERT_EQ(B[j], A[j]);
+        }
+    }
+}
+
+TEST(bit_stream, fixed_widths)
+{
+    fixed_roundtrip_unaligned<1>();
+    fixed_roundtrip_unaligned<7>();
+    fixed_roundtrip_unaligned<8>();
+    fixed_roundtrip_unaligned<13>();
+    fixed_roundtrip_unaligned<32>();
+    fixed_roundtrip_unaligned<33>();
+    fixed_roundtrip_unaligned<57>();
+    fixed_roundtrip_unaligned<58>();
+    fixed_roundtrip_unaligned<64>();
+}
+
 TEST(bit_stream, aligned_fixed)
 {
     size_t n = 20;
@@ -127,6 +229,124 @@ TEST(bit_stream, aligned_fixed)
     }
 }
 
+TEST(bit_stream, aligned_fixed_unaligned_prefix)
+{
+    // the coder has to start at the next byte boundary for every prefix length
+    std::mt19937 gen(4711);
+    for (uint8_t prefix = 1; prefix < 64; prefix++) {
+        std::vector<uint32_t> A(1 + gen() % 50);
+        for (auto& x : A)
+            x = gen();
+        coder::aligned_fixed<uint32_t> c;
+        sdsl::bit_vector bv;
+        {
+            bit_ostream<sdsl::bit_vector> os(bv);
+            os.put_int(4711 & sdsl::bits::lo_set[prefix], prefix);
+            c.encode(os, A.data(), A.size());
+            ASSERT_EQ(os.tellp(), 8 * ((prefix + 7) / 8) + 32 * A.size());
+            os.put_int(4711, 13);
+        }
+        std::vector<uint32_t> B(A.size());
+        {
+            bit_istream<sdsl::bit_vector> is(bv);
+            ASSERT_EQ(is.get_int(prefix), 4711 & sdsl::bits::lo_set[prefix]);
+            c.decode(is, B.data(), B.size());
+            ASSERT_EQ(is.get_int(13), 4711ULL);
+        }
+        ASSERT_EQ(B, A);
+    }
+}
+
+template <class t_coder>
+void aligned_coder_roundtrip()
+{
+    size_t n = 20;
+    std::mt19937 gen(4711);
+    std::uniform_int_distribution<uint64_t> len_dis(1, 5000);
+    std::uniform_int_distribution<uint32_t> width_dis(0, 32);
+
+    for (size_t i = 0; i < n; i++) {
+        size_t len = len_dis(gen);
+        uint32_t width = width_dis(gen);
+        std::vector<uint32_t> A(len);
+        for (size_t j = 0; j < len; j++) { // mostly small values with a few exceptions
+            uint32_t w = gen() % 10 ? width : 32;
+            A[j] = w == 32 ? gen() : gen() & ((1ULL << w) - 1);
+        }
+        t_coder c;
+        sdsl::bit_vector bv;
+        {
+            bit_ostream<sdsl::bit_vector> os(bv);
+            os.put_int(4711, 13); // the coders byte align
+            c.encode(os, A.data(), len);
+            os.put_int(4711, 13);
+        }
+        std::vector<uint32_t> B(len);
+        {
+            bit_istream<sdsl::bit_vector> is(bv);
+            ASSERT_EQ(is.get_int(13), 4711ULL);
+            c.decode(is, B.data(), len);
+            ASSERT_EQ(is.get_int(13), 4711ULL);
+        }
+        for (size_t j = 0; j < len; j++) {
+            ASSERT_EQ(B[j], A[j]);
+        }
+    }
+}
+
+TEST(bit_stream, simd_bp128)
+{
+    aligned_coder_roundtrip<coder::simd_bp128>();
+}
+
+TEST(bit_stream, simd_pfor)
+{
+    aligned_coder_roundtrip<coder::simd_pfor>();
+}
+
+TEST(bit_stream, rans)
+{
+    aligned_coder_roundtrip<coder::rans<1> >();
+    aligned_coder_roundtrip<coder::rans<4> >();
+}
+
+TEST(bit_stream, rans_static)
+{
+    aligned_coder_roundtrip<coder::rans_static<4> >(); // untrained, all symbols equally likely
+
+    std::mt19937 gen(4711);
+    std::geometric_distribution<uint32_t> dis(0.05);
+    std::vector<std::vector<uint32_t> > samples(10, std::vector<uint32_t>(1000));
+    for (auto& sample : samples)
+        for (auto& x : sample)
+            x = dis(gen);
+    auto model = coder::rans_static<4>::train(samples);
+    coder::rans_static<4> enc;
+    coder::rans_static<4> dec;
+    enc.set_model(model);
+    dec.set_model(model);
+    for (size_t i = 0; i < 20; i++) {
+        std::vector<uint32_t> A(gen() % 5000);
+        for (auto& x : A) // including values not seen in training
+            x = gen() % 10 ? dis(gen) : gen();
+        sdsl::bit_vector bv;
+        {
+            bit_ostream<sdsl::bit_vector> os(bv);
+            os.put_int(4711, 13);
+            enc.encode(os, A.data(), A.size());
+            os.put_int(4711, 13);
+        }
+        std::vector<uint32_t> B(A.size());
+        {
+            bit_istream<sdsl::bit_vector> is(bv);
+            ASSERT_EQ(is.get_int(13), 4711ULL);
+            dec.decode(is, B.data(), B.size());
+            ASSERT_EQ(is.get_int(13), 4711ULL);
+        }
+        ASSERT_EQ(B, A);
+    }
+}
+
 TEST(bit_stream, zlib)
 {
     size_t n = 20;
@@ -377,6 +597,800 @@ TEST(bit_stream, lzma_uint8)
     }
 }
 
+template <class t_cache>
+void block_cache_eviction()
+{
+    // 2 blocks of 100 bytes fit into a single shard
+    t_cache cache(250, 1);
+    size_t decodes = 0;
+    auto decode = [&decodes](uint64_t id) {
+        decodes++;
+        return std::vector<uint8_t>(100, (uint8_t)id);
+    };
+    for (uint64_t id = 0; id < 3; id++) {
+        auto b = cache.get(id, [&] { return decode(id); });
+        ASSERT_EQ(b->size(), 100ULL);
+        ASSERT_EQ((*b)[0], id);
+    }
+    auto stats = cache.stats();
+    ASSERT_EQ(stats.misses, 3ULL);
+    ASSERT_EQ(stats.hits, 0ULL);
+    ASSERT_EQ(stats.evictions, 1ULL);
+    ASSERT_EQ(stats.cached_blocks, 2ULL);
+    ASSERT_EQ(stats.cached_bytes, 200ULL);
+    // block 0 was evicted, block 2 is still cached
+    cache.get(2, [&] { return decode(2); });
+    ASSERT_EQ(decodes, 3ULL);
+    cache.get(0, [&] { return decode(0); });
+    ASSERT_EQ(decodes, 4ULL);
+    stats = cache.stats();
+    ASSERT_EQ(stats.hits, 1ULL);
+    ASSERT_EQ(stats.misses, 4ULL);
+    ASSERT_EQ(stats.evictions, 2ULL);
+}
+
+TEST(block_cache, lru)
+{
+    block_cache_eviction<block_cache<cache_policy_lru> >();
+}
+
+TEST(block_cache, clock)
+{
+    block_cache_eviction<block_cache<cache_policy_clock> >();
+}
+
+TEST(block_cache, sharded_budget)
+{
+    /* 100 bytes per shard, so each shard holds the last 10 of its blocks */
+    block_cache<cache_policy_lru> cache(16 * 100, 16);
+    auto block = [] { return std::vector<uint8_t>(10); };
+    for (uint64_t id = 0; id < 1000; id++) {
+        cache.get(id, block);
+        ASSERT_LE(cache.stats().cached_bytes, 16ULL * 100);
+    }
+    auto stats = cache.stats();
+    ASSERT_EQ(stats.misses, 1000ULL);
+    ASSERT_EQ(stats.cached_blocks, 160ULL);
+    ASSERT_EQ(stats.cached_bytes, 1600ULL);
+    ASSERT_EQ(stats.evictions, 840ULL);
+
+    /* the most recent 10 ids of every shard are cached */
+    bool decoded = false;
+    auto decode = [&] { decoded = true; return std::vector<uint8_t>(10); };
+    for (uint64_t id = 840; id < 1000; id++) {
+        decoded = false;
+        cache.get(id, decode);
+        ASSERT_FALSE(decoded) << "block " << id << " was evicted";
+    }
+    /* the least recent block of each shard was evicted before them */
+    for (uint64_t id = 824; id < 840; id++) {
+        decoded = false;
+        cache.get(id, decode);
+        ASSERT_TRUE(decoded) << "block " << id << " was not evicted";
+    }
+    stats = cache.stats();
+    ASSERT_EQ(stats.hits, 160ULL);
+    ASSERT_EQ(stats.misses, 1016ULL);
+    ASSERT_EQ(stats.cached_bytes, 1600ULL);
+}
+
+struct mock_block_store {
+    struct decode_context {
+        decode_context(const mock_block_store&) {}
+    };
+    mutable std::atomic<size_t> decoded{ 0 };
+    void prefetch_blocks(const std::vector<uint64_t>&) const {}
+    std::vector<uint8_t> block(uint64_t block_id, decode_context&) const
+    {
+        decoded++;
+        return std::vector<uint8_t>(block_id % 7 + 1, (uint8_t)block_id);
+    }
+};
+
+TEST(block_batch, request_order)
+{
+    mock_block_store store;
+    std::vector<uint64_t> ids = { 42, 3, 17, 3, 99, 0, 42, 5 };
+    std::vector<uint64_t> returned;
+    decode_blocks_batched(store, ids, [&](uint64_t id, const std::vector<uint8_t>& content) {
+        ASSERT_EQ(content.size(), id % 7 + 1);
+        ASSERT_EQ(content[0], (uint8_t)id);
+        returned.push_back(id);
+    }, 4);
+    ASSERT_EQ(returned, ids);
+    ASSERT_EQ(store.decoded.load(), 6ULL);
+}
+
+TEST(block_batch, large_batch)
+{
+    /* enough blocks that several workers are started */
+    mock_block_store store;
+    std::vector<uint64_t> ids;
+    for (uint64_t id = 0; id < 1000; id++)
+        ids.push_back((id * 7919) % 500);
+    size_t i = 0;
+    decode_blocks_batched(store, ids, [&](uint64_t id, const std::vector<uint8_t>& content) {
+        ASSERT_EQ(id, ids[i++]);
+        ASSERT_EQ(content.size(), id % 7 + 1);
+        ASSERT_EQ(content[0], (uint8_t)id);
+    }, 8);
+    ASSERT_EQ(i, ids.size());
+    ASSERT_EQ(store.decoded.load(), 500ULL);
+}
+
+/* a small collection of words with random bytes in between, so blocks have
+   long and short dictionary factors and literals */
+static std::string create_test_collection(const std::string& name, std::vector<uint8_t>& text)
+{
+    std::string dir = "/tmp/rlz-unit-tests-" + name;
+    utils::create_directory(dir);
+    std::mt19937 gen(4711);
+    const std::vector<std::string> words = { "the ", "quick ", "brown ", "fox ", "jumps ", "over ", "lazy ", "dogs ", "<doc>", "</doc>\n" };
+    text.clear();
+    while (text.size() < 100000) {
+        const auto& w = words[gen() % words.size()];
+        text.insert(text.end(), w.begin(), w.end());
+        if (gen() % 8 == 0)
+            text.push_back(2 + gen() % 254); // create-collection removes 0 and 1
+    }
+    sdsl::int_vector<8> tmp(text.size());
+    std::copy(text.begin(), text.end(), tmp.begin());
+    sdsl::store_to_file(tmp, dir + "/" + KEY_PREFIX + KEY_TEXT);
+    return dir;
+}
+
+template <bool t_search_local_block_context>
+using test_store_type = rlz_store_static<dict_uniform_sample_budget<256>,
+    dict_prune_none,
+    dict_index_hash<16>,
+    1024,
+    t_search_local_block_context,
+    factor_select_first,
+    factor_coder_blocked<3, coder::aligned_fixed<uint8_t>, coder::aligned_fixed<uint32_t>, coder::vbyte>,
+    block_map_uncompressed>;
+
+template <class t_store>
+void extract_matches_text(const std::string& name)
+{
+    std::vector<uint8_t> text;
+    collection col(create_test_collection(name, text));
+    auto store = typename t_store::builder{}
+                     .set_rebuild(true)
+                     .set_threads(1)
+                     .set_dict_size(16 * 1024)
+                     .build_or_load(col);
+    ASSERT_EQ(store.size(), text.size());
+    typename t_store::decode_context ctx(store);
+    const uint64_t block_size = t_store::block_size;
+    std::vector<uint8_t> out(4 * block_size);
+    auto check = [&](uint64_t offset, uint64_t len) {
+        uint64_t expected = offset >= text.size() ? 0 : std::min(len, text.size() - offset);
+        ASSERT_EQ(store.extract(offset, len, out.data()), expected);
+        ASSERT_TRUE(std::equal(out.begin(), out.begin() + expected, text.begin() + offset));
+        ASSERT_EQ(store.extract(offset, len, out.data(), ctx), expected);
+        ASSERT_TRUE(std::equal(out.begin(), out.begin() + expected, text.begin() + offset));
+    };
+    // every start position of the first blocks, most of them inside a factor
+    for (uint64_t offset = 0; offset < 2 * block_size + 10; offset++)
+        check(offset, 7);
+    // ranges crossing one or more block boundaries
+    std::mt19937 gen(4711);
+    for (size_t i = 0; i < 200; i++)
+        check(gen() % text.size(), gen() % (3 * block_size));
+    check(block_size - 1, 2);
+    check(block_size, block_size);
+    check(0, 0);
+    // ranges ending past or starting at the end of the text
+    check(text.size() - 10, 100);
+    check(text.size() - 1, 4 * block_size);
+    check(text.size(), 10);
+    check(text.size() + 5, 10);
+
+    // decode_block_range directly, including a last block shorter than block_size
+    const uint64_t num_blocks = (text.size() + block_size - 1) / block_size;
+    for (uint64_t block_id : { (uint64_t)0, (uint64_t)1, num_blocks - 1 }) {
+        uint64_t block_begin = block_id * block_size;
+        uint64_t block_len = std::min(block_size, text.size() - block_begin);
+        for (uint64_t from = 0; from <= block_size; from += 13) {
+            for (uint64_t to = from; to <= block_size; to += 17) {
+                uint64_t expected_to = std::min(to, block_len);
+                uint64_t expected = from < expected_to ? expected_to - from : 0;
+                ASSERT_EQ(store.decode_block_range(block_id, from, to, out.data(), ctx), expected);
+                ASSERT_TRUE(std::equal(out.begin(), out.begin() + expected, text.begin() + block_begin + from));
+            }
+        }
+    }
+}
+
+TEST(rlz_store_static, extract)
+{
+    extract_matches_text<test_store_type<false> >("extract");
+}
+
+TEST(rlz_store_static, extract_local_block_context)
+{
+    extract_matches_text<test_store_type<true> >("extract-local");
+}
+
+template <class t_block_map>
+void same_block_map(const block_map_uncompressed& expected, const t_block_map& bm, uint64_t text_size)
+{
+    ASSERT_EQ(bm.num_blocks(), expected.num_blocks());
+    ASSERT_EQ(bm.variable_block_sizes(), expected.variable_block_sizes());
+    for (size_t i = 0; i < expected.num_blocks(); i++) {
+        ASSERT_EQ(bm.block_offset(i), expected.block_offset(i)) << "block " << i;
+        ASSERT_EQ(bm.block_factors(i), expected.block_factors(i)) << "block " << i;
+        if (expected.variable_block_sizes())
+            ASSERT_EQ(bm.block_text_start(i), expected.block_text_start(i)) << "block " << i;
+    }
+    if (expected.variable_block_sizes()) {
+        for (uint64_t pos = 0; pos < text_size + 10; pos++)
+            ASSERT_EQ(bm.block_containing(pos), expected.block_containing(pos)) << "pos " << pos;
+    }
+}
+
+TEST(block_map_ef, same_as_uncompressed)
+{
+    std::vector<uint8_t> text;
+    collection col(create_test_collection("block-maps", text));
+    // blocks 1 and 4 take no space in the factor stream
+    sdsl::int_vector<> offsets = { 0, 100, 100, 250, 1000, 1000, 1234 };
+    sdsl::int_vector<> factors = { 10, 0, 15, 70, 0, 9, 3 };
+    sdsl::int_vector<> starts = { 0, 7, 20, 21, 400, 1000, 1001 };
+    col.file_map[KEY_BLOCKOFFSETS] = col.path + "/index/test-ef-offsets.sdsl";
+    col.file_map[KEY_BLOCKFACTORS] = col.path + "/index/test-ef-factors.sdsl";
+    sdsl::store_to_file(offsets, col.file_map[KEY_BLOCKOFFSETS]);
+    sdsl::store_to_file(factors, col.file_map[KEY_BLOCKFACTORS]);
+    const uint64_t text_size = 1100;
+
+    for (bool variable : { false, true }) {
+        if (variable) {
+            col.file_map[KEY_BLOCKSTARTS] = col.path + "/index/test-ef-starts.sdsl";
+            sdsl::store_to_file(starts, col.file_map[KEY_BLOCKSTARTS]);
+        }
+        block_map_uncompressed expected(col);
+        block_map_ef bm(col);
+        same_block_map(expected, bm, text_size);
+
+        // serialize/load round trip re-binds the select and rank supports
+        auto file_name = col.path + "/index/test-ef-blockmap.sdsl";
+        sdsl::store_to_file(bm, file_name);
+        block_map_ef loaded;
+        sdsl::load_from_file(loaded, file_name);
+        same_block_map(expected, loaded, text_size);
+
+        // and so does a move
+        block_map_ef moved;
+        moved = std::move(loaded);
+        same_block_map(expected, moved, text_size);
+        block_map_ef move_constructed(std::move(moved));
+        same_block_map(expected, move_constructed, text_size);
+    }
+}
+
+TEST(block_map_mapped, moved_collection)
+{
+    std::string dir = "/tmp/rlz-unit-tests-mapped";
+    std::string moved_dir = dir + "-moved";
+    if (utils::directory_exists(moved_dir)) // moved there by an earlier run
+        ASSERT_EQ(std::rename(moved_dir.c_str(), dir.c_str()), 0);
+    std::vector<uint8_t> text;
+    create_test_collection("mapped", text);
+    sdsl::int_vector<> offsets = { 0, 100, 250, 400 };
+    sdsl::int_vector<> factors = { 10, 15, 15, 3 };
+    {
+        collection col(dir);
+        col.file_map[KEY_BLOCKOFFSETS] = col.path + "/index/test-offsets.sdsl";
+        col.file_map[KEY_BLOCKFACTORS] = col.path + "/index/test-factors.sdsl";
+        sdsl::store_to_file(offsets, col.file_map[KEY_BLOCKOFFSETS]);
+        sdsl::store_to_file(factors, col.file_map[KEY_BLOCKFACTORS]);
+        block_map_mapped bm(col);
+        sdsl::store_to_file(bm, col.path + "/index/test-blockmap.sdsl");
+    }
+    ASSERT_EQ(std::rename(dir.c_str(), moved_dir.c_str()), 0);
+
+    collection col(moved_dir);
+    col.file_map[KEY_BLOCKMAP] = col.path + "/index/test-blockmap.sdsl";
+    block_map_mapped bm;
+    load_block_map(bm, col);
+    ASSERT_EQ(bm.num_blocks(), offsets.size());
+    for (size_t i = 0; i < offsets.size(); i++) {
+        ASSERT_EQ(bm.block_offset(i), offsets[i]);
+        ASSERT_EQ(bm.block_factors(i), factors[i]);
+    }
+}
+
+TEST(document_map, ranges)
+{
+    // text of 50 bytes with a header before the first document
+    document_map dm({ 5, 20, 21, 40 }, { "d3", "d1", "d4", "d2" }, 50);
+    ASSERT_EQ(dm.num_docs(), 4ULL);
+    typedef std::pair<uint64_t, uint64_t> range;
+    ASSERT_EQ(dm.document_range(0), range(5, 20));
+    ASSERT_EQ(dm.document_range(1), range(20, 21));
+    ASSERT_EQ(dm.document_range(2), range(21, 40));
+    ASSERT_EQ(dm.document_range(3), range(40, 50));
+    ASSERT_THROW(dm.document_range(4), std::runtime_error);
+
+    uint64_t expected_doc[50];
+    for (uint64_t pos = 0; pos < 50; pos++)
+        expected_doc[pos] = pos < 20 ? 0 : pos < 21 ? 1 : pos < 40 ? 2 : 3;
+    for (uint64_t pos = 0; pos < 50; pos++)
+        ASSERT_EQ(dm.document_at(pos), expected_doc[pos]);
+
+    ASSERT_EQ(dm.docno(0), "d3");
+    ASSERT_EQ(dm.docno(3), "d2");
+    ASSERT_EQ(dm.doc_id("d1"), 1ULL);
+    ASSERT_EQ(dm.doc_id("d2"), 3ULL);
+    ASSERT_EQ(dm.doc_id("d5"), dm.num_docs());
+    ASSERT_THROW(dm.docno(4), std::runtime_error);
+
+    // stores built without a DOCORDER file have an empty map
+    document_map empty;
+    ASSERT_EQ(empty.num_docs(), 0ULL);
+    ASSERT_THROW(empty.document_range(0), std::runtime_error);
+    ASSERT_THROW(empty.document_at(0), std::runtime_error);
+}
+
+/* TREC style records after a header, and a DOCORDER file with the
+   <DOCNO> offsets as create-collection writes it */
+static std::string create_trec_collection(const std::string& name, const std::vector<std::string>& body_sizes_docnos,
+    std::string& text, std::vector<uint64_t>& doc_tags, std::vector<uint64_t>& docno_tags)
+{
+    std::string dir = "/tmp/rlz-unit-tests-" + name;
+    utils::create_directory(dir);
+    text = "collection header\n";
+    doc_tags.clear();
+    docno_tags.clear();
+    for (size_t i = 0; i < body_sizes_docnos.size(); i++) {
+        doc_tags.push_back(text.size());
+        text += "<DOC>\n";
+        docno_tags.push_back(text.size());
+        text += "<DOCNO>" + body_sizes_docnos[i] + "</DOCNO>\n" + std::string(100 * (i + 1), 'a' + i) + "\n</DOC>\n";
+    }
+    sdsl::int_vector<8> tmp(text.size());
+    std::copy(text.begin(), text.end(), tmp.begin());
+    sdsl::store_to_file(tmp, dir + "/" + KEY_PREFIX + KEY_TEXT);
+    std::ofstream dof(dir + "/" + KEY_PREFIX + KEY_DOCORDER);
+    for (size_t i = 0; i < body_sizes_docnos.size(); i++)
+        dof << body_sizes_docnos[i] << " " << docno_tags[i] << "\n";
+    return dir;
+}
+
+TEST(document_map, whole_trec_records)
+{
+    std::string text;
+    std::vector<uint64_t> doc_tags, docno_tags;
+    collection col(create_trec_collection("trec", { "d1", "d2", "d3", "d4" }, text, doc_tags, docno_tags));
+    document_map dm(col);
+    ASSERT_EQ(dm.num_docs(), 4ULL);
+    for (size_t i = 0; i < dm.num_docs(); i++) {
+        auto r = dm.document_range(i);
+        ASSERT_EQ(r.first, doc_tags[i]);
+        auto doc = text.substr(r.first, r.second - r.first);
+        ASSERT_EQ(doc.compare(0, 5, "<DOC>"), 0) << doc;
+        ASSERT_EQ(doc.compare(doc.size() - 7, 7, "</DOC>\n"), 0) << doc;
+    }
+    ASSERT_EQ(dm.document_at(docno_tags[2] - 1), 2ULL);
+
+    // blocks of at most 400 bytes start at <DOC> tags, except inside the last
+    // document, the only one larger than a block
+    auto starts = document_map::document_aligned_block_starts(col, 400);
+    for (const auto& start : starts) {
+        if (start < doc_tags.back())
+            ASSERT_TRUE(start == 0 || std::find(doc_tags.begin(), doc_tags.end(), start) != doc_tags.end()) << start;
+    }
+    ASSERT_TRUE(std::find(starts.begin(), starts.end(), doc_tags.back()) != starts.end());
+
+    // positions have to increase
+    {
+        std::ofstream dof(document_map::docorder_file_name(col));
+        dof << "d1 " << docno_tags[1] << "\n"
+            << "d2 " << docno_tags[0] << "\n";
+    }
+    ASSERT_THROW(document_map::document_aligned_block_starts(col, 400), std::runtime_error);
+    ASSERT_THROW(document_map dm_unsorted(col), std::runtime_error);
+}
+
+TEST(concurrent_queue, bounded_producer_consumer)
+{
+    const uint64_t n = 100000;
+    concurrent_queue<uint64_t> q(16);
+    auto producer = std::async(std::launch::async, [&] {
+        for (uint64_t i = 0; i < n; i++)
+            q.push(i);
+        q.close();
+    });
+    std::vector<std::future<uint64_t> > consumers;
+    for (size_t t = 0; t < 4; t++) {
+        consumers.push_back(std::async(std::launch::async, [&] {
+            uint64_t sum = 0, elem;
+            while (q.pop(elem)) {
+                EXPECT_LE(q.size(), 16ULL);
+                sum += elem;
+            }
+            return sum;
+        }));
+    }
+    producer.get();
+    uint64_t sum = 0;
+    for (auto& c : consumers)
+        sum += c.get();
+    ASSERT_EQ(sum, n * (n - 1) / 2);
+    ASSERT_FALSE(q.push(n));
+}
+
+TEST(factor_batch, encode_append_decode)
+{
+    const size_t block_size = 4096;
+    std::mt19937 gen(4711);
+    std::uniform_int_distribution<uint32_t> len_dis(1, 40);
+    std::uniform_int_distribution<uint32_t> off_dis(0, 1 << 20);
+    std::vector<uint8_t> text(block_size);
+    for (auto& sym : text)
+        sym = gen() % 256;
+
+    factor_coder_blocked<3> coder;
+    factor_batcher fb(block_size);
+    for (size_t b = 0; b < 5; b++) {
+        fb.start_new_block();
+        size_t pos = 0;
+        while (pos < block_size) {
+            uint32_t len = std::min((size_t)len_dis(gen), block_size - pos);
+            fb.add_to_block_factor(coder, text.begin() + pos, off_dis(gen), len);
+            pos += len;
+        }
+        fb.encode_current_block(coder);
+    }
+    factor_batch batch;
+    batch.blocks = fb.take();
+    ASSERT_EQ(batch.blocks.size(), 5ULL);
+    auto expected = batch.blocks;
+    auto eb = encode_factor_batch(coder, batch);
+
+    // append to a stream at an odd position the way factor_storage does
+    sdsl::bit_vector bv;
+    uint64_t batch_start;
+    {
+        bit_ostream<sdsl::bit_vector> os(bv);
+        os.put_int(4711, 13);
+        os.align64();
+        batch_start = os.tellp();
+        os.append(eb.bits);
+    }
+    block_factor_data bfd(block_size);
+    for (size_t b = 0; b < expected.size(); b++) {
+        bit_istream<sdsl::bit_vector> is(bv, batch_start + eb.block_offsets[b]);
+        ASSERT_EQ(eb.block_factors[b], expected[b].num_factors);
+        coder.decode_block(is, bfd, eb.block_factors[b]);
+        ASSERT_EQ(bfd.num_literals, expected[b].num_literals);
+        ASSERT_EQ(bfd.num_offsets, expected[b].num_offsets);
+        for (size_t i = 0; i < bfd.num_factors; i++)
+            ASSERT_EQ(bfd.lengths[i], expected[b].lengths[i]);
+        for (size_t i = 0; i < bfd.num_offsets; i++)
+            ASSERT_EQ(bfd.offsets[i], expected[b].offsets[i]);
+        for (size_t i = 0; i < bfd.num_literals; i++)
+            ASSERT_EQ(bfd.literals[i], expected[b].literals[i]);
+    }
+}
+
+TEST(factor_coder, trained_models)
+{
+    typedef factor_coder_blocked<3, coder::zlib_dict<6>, coder::rans_static<>, coder::rans_static<> > coder_type;
+    static_assert(coder_type::trainable, "rans_static and zlib_dict have models");
+    static_assert(!factor_coder_blocked<3>::trainable, "the default coders have no models");
+    const size_t block_size = 1024;
+    std::mt19937 gen(4711);
+    std::string text;
+    while (text.size() < 100 * block_size)
+        text += "<doc id=" + std::to_string(gen() % 100000) + "><title>";
+
+    coder_type enc;
+    auto factorize = [&](size_t start) {
+        block_factor_data bfd(block_size);
+        size_t pos = 0;
+        while (pos < block_size) {
+            uint32_t len = std::min((size_t)(1 + gen() % 8), block_size - pos);
+            bfd.add_factor(enc, text.begin() + start + pos, gen() % 100000, len);
+            pos += len;
+        }
+        return bfd.compact();
+    };
+    std::vector<block_factor_data> samples;
+    for (size_t b = 0; b < 20; b++)
+        samples.push_back(factorize(b * block_size));
+    enc.train(samples);
+
+    // the decoder loads the stored models, decode contexts copy them
+    std::stringstream models;
+    enc.store_models(models);
+    coder_type loaded;
+    loaded.load_models(models);
+    coder_type dec;
+    copy_models(loaded, dec);
+    for (size_t i = 0; i < 10; i++) {
+        auto bfd = factorize(gen() % (text.size() - block_size));
+        auto expected = bfd;
+        sdsl::bit_vector bv;
+        {
+            bit_ostream<sdsl::bit_vector> os(bv);
+            enc.encode_block(os, bfd);
+        }
+        block_factor_data out(block_size);
+        bit_istream<sdsl::bit_vector> is(bv);
+        dec.decode_block(is, out, expected.num_factors);
+        ASSERT_EQ(out.num_literals, expected.num_literals);
+        ASSERT_EQ(out.num_offsets, expected.num_offsets);
+        for (size_t j = 0; j < out.num_factors; j++)
+            ASSERT_EQ(out.lengths[j], expected.lengths[j]);
+        for (size_t j = 0; j < out.num_offsets; j++)
+            ASSERT_EQ(out.offsets[j], expected.offsets[j]);
+        for (size_t j = 0; j < out.num_literals; j++)
+            ASSERT_EQ(out.literals[j], expected.literals[j]);
+    }
+}
+
+TEST(dict_index_hash, greedy_factors)
+{
+    std::mt19937 gen(4711);
+    // small alphabet so there are many short and long repeats
+    sdsl::int_vector<8> dict(5000);
+    for (size_t i = 0; i < dict.size(); i++)
+        dict[i] = 'a' + gen() % 4;
+    std::vector<uint8_t> text;
+    for (size_t i = 0; i < 500; i++) { // copies of dictionary substrings with noise in between
+        size_t start = gen() % dict.size();
+        size_t len = std::min((size_t)(gen() % 100), dict.size() - start);
+        for (size_t j = 0; j < len; j++)
+            text.push_back(dict[start + j]);
+        text.push_back('a' + gen() % 6);
+    }
+    dict_index_hash<16, 0> idx(dict); // exact mode, the default chain bound is approximate
+    auto factor_itr = idx.factorize<std::vector<uint8_t>::const_iterator, false>(text.cbegin(), text.cend());
+    size_t pos = 0;
+    while (!factor_itr.finished()) {
+        // brute force longest match
+        size_t max_len = 0;
+        for (size_t p = 0; p < dict.size(); p++) {
+            size_t l = 0;
+            while (pos + l < text.size() && p + l < dict.size() && dict[p + l] == text[pos + l])
+                l++;
+            max_len = std::max(max_len, l);
+        }
+        ASSERT_EQ(factor_itr.len, max_len);
+        for (size_t j = 0; j < factor_itr.len; j++)
+            ASSERT_EQ(dict[idx.sa[factor_itr.sp] + j], text[pos + j]);
+        pos += std::max(factor_itr.len, (uint64_t)1);
+        ++factor_itr;
+    }
+    ASSERT_EQ(pos, text.size());
+}
+
+/* dictionary over a small alphabet terminated by 0 as the dictionaries
+   written during construction, and a text of dictionary substrings with
+   noise in between which includes symbols not in the dictionary */
+static void random_dictionary_and_text(sdsl::int_vector<8>& dict, std::vector<uint8_t>& text, size_t dict_size, size_t num_pieces)
+{
+    std::mt19937 gen(4711);
+    dict = sdsl::int_vector<8>(dict_size);
+    for (size_t i = 0; i + 1 < dict.size(); i++)
+        dict[i] = 'a' + gen() % 4;
+    dict[dict.size() - 1] = 0;
+    text.clear();
+    for (size_t i = 0; i < num_pieces; i++) {
+        size_t start = gen() % (dict.size() - 1);
+        size_t len = std::min((size_t)(gen() % 100), dict.size() - 1 - start);
+        for (size_t j = 0; j < len; j++)
+            text.push_back(dict[start + j]);
+        text.push_back('a' + gen() % 6);
+    }
+}
+
+TEST(dict_index_sa_lcp, same_factors_as_sa)
+{
+    sdsl::int_vector<8> dict;
+    std::vector<uint8_t> text;
+    random_dictionary_and_text(dict, text, 5000, 500);
+    dict_index_sa sa_idx(dict);
+    dict_index_sa_lcp lcp_idx(dict);
+    typedef std::vector<uint8_t>::const_iterator itr_type;
+    auto sa_itr = sa_idx.factorize<itr_type, false>(text.cbegin(), text.cend());
+    auto lcp_itr = lcp_idx.factorize<itr_type, false>(text.cbegin(), text.cend());
+    size_t num_factors = 0;
+    while (!sa_itr.finished()) {
+        ASSERT_FALSE(lcp_itr.finished());
+        ASSERT_EQ(lcp_itr.len, sa_itr.len);
+        if (sa_itr.len != 0) {
+            ASSERT_EQ(lcp_itr.sp, sa_itr.sp);
+            ASSERT_EQ(lcp_itr.ep, sa_itr.ep);
+            ASSERT_EQ(lcp_itr.interval_lcp(), sa_itr.interval_lcp()); // with and without the LCP array
+            ASSERT_GE(sa_itr.interval_lcp(), sa_itr.len);
+        }
+        ++sa_itr;
+        ++lcp_itr;
+        num_factors++;
+    }
+    ASSERT_TRUE(lcp_itr.finished());
+    ASSERT_GT(num_factors, 500ULL);
+}
+
+/* the q-gram table only replaces the first backward search steps */
+template <class t_qgram_index>
+void same_factors_as_csa(const dict_index_csa<>& csa_idx, const t_qgram_index& qgram_idx, const std::vector<uint8_t>& text)
+{
+    typedef std::vector<uint8_t>::const_iterator itr_type;
+    auto csa_itr = csa_idx.factorize<itr_type, false>(text.cbegin(), text.cend());
+    auto qgram_itr = qgram_idx.template factorize<itr_type, false>(text.cbegin(), text.cend());
+    while (!csa_itr.finished()) {
+        ASSERT_FALSE(qgram_itr.finished());
+        ASSERT_EQ(qgram_itr.len, csa_itr.len);
+        if (csa_itr.len != 0) {
+            ASSERT_EQ(qgram_itr.sp, csa_itr.sp);
+            ASSERT_EQ(qgram_itr.ep, csa_itr.ep);
+        }
+        ++csa_itr;
+        ++qgram_itr;
+    }
+    ASSERT_TRUE(qgram_itr.finished());
+}
+
+TEST(dict_index_csa_qgram, same_factors_as_csa)
+{
+    sdsl::int_vector<8> dict;
+    std::vector<uint8_t> text;
+    // symbols 'e' and 'f' of the text are not in the dictionary, so are the q-grams containing them
+    random_dictionary_and_text(dict, text, 5000, 500);
+    dict_index_csa<> csa_idx(dict);
+    dict_index_csa_qgram<sdsl::csa_wt<sdsl::wt_huff<sdsl::bit_vector_il<64> >, 4, 4096>, 2> q2_idx(dict);
+    dict_index_csa_qgram<sdsl::csa_wt<sdsl::wt_huff<sdsl::bit_vector_il<64> >, 4, 4096>, 3> q3_idx(dict);
+    dict_index_csa_qgram<sdsl::csa_wt<sdsl::wt_huff<sdsl::bit_vector_il<64> >, 4, 4096>, 3, true> q3_sparse_idx(dict);
+    same_factors_as_csa(csa_idx, q2_idx, text);
+    same_factors_as_csa(csa_idx, q3_idx, text);
+    same_factors_as_csa(csa_idx, q3_sparse_idx, text);
+    // patterns shorter than q, with and without symbols of the dictionary
+    for (size_t len = 0; len < 3; len++) {
+        for (char sym : { 'a', 'e' }) {
+            std::vector<uint8_t> pattern(len, sym);
+            same_factors_as_csa(csa_idx, q2_idx, pattern);
+            same_factors_as_csa(csa_idx, q3_idx, pattern);
+            same_factors_as_csa(csa_idx, q3_sparse_idx, pattern);
+        }
+    }
+}
+
+TEST(factorizor, optimal_parse)
+{
+    const size_t block_size = 4096;
+    std::mt19937 gen(4711);
+    sdsl::int_vector<8> dict(5000);
+    for (size_t i = 0; i < dict.size(); i++)
+        dict[i] = 'a' + gen() % 4;
+    std::vector<uint8_t> text;
+    while (text.size() < block_size) {
+        size_t start = gen() % dict.size();
+        size_t len = std::min((size_t)(gen() % 100), dict.size() - start);
+        for (size_t j = 0; j < len; j++)
+            text.push_back(dict[start + j]);
+        text.push_back('a' + gen() % 6);
+    }
+    text.resize(block_size);
+    dict_index_hash<16> idx(dict);
+
+    using coder_type = factor_coder_blocked<3, coder::fixed<32>, coder::fixed<13>, coder::vbyte>;
+    using greedy_type = factorizor<block_size, false, dict_index_hash<16>, factor_select_first, coder_type>;
+    using optimal_type = factorizor<block_size, false, dict_index_hash<16>, factor_select_optimal<>, coder_type>;
+    coder_type coder;
+    greedy_type::local_context_type local_ctx;
+    factor_batcher fb(block_size);
+    greedy_type::factorize_block(fb, coder, idx, text.cbegin(), text.cend(), local_ctx);
+    optimal_type::factorize_block(fb, coder, idx, text.cbegin(), text.cend(), local_ctx);
+    auto blocks = fb.take();
+    ASSERT_EQ(blocks.size(), 2ULL);
+
+    std::vector<uint64_t> bits;
+    for (const auto& bfd : blocks) {
+        std::vector<uint8_t> decoded;
+        uint64_t b = 0;
+        size_t literals = 0, offsets = 0;
+        for (size_t i = 0; i < bfd.num_factors; i++) {
+            auto len = bfd.lengths[i];
+            if (len <= coder_type::literal_threshold) {
+                b += coder.literal_factor_bits(bfd.literals.begin() + literals, len);
+                for (size_t j = 0; j < len; j++)
+                    decoded.push_back(bfd.literals[literals++]);
+            }
+            else {
+                auto offset = bfd.offsets[offsets++];
+                b += coder.factor_bits(offset, len);
+                for (size_t j = 0; j < len; j++)
+                    decoded.push_back(dict[offset + j]);
+            }
+        }
+        ASSERT_TRUE(decoded == text);
+        bits.push_back(b);
+    }
+    ASSERT_LE(bits[1], bits[0]);
+}
+
+TEST(factor_selector, nearest)
+{
+    struct {
+        std::vector<uint64_t> sa = { 90, 10, 50, 70, 30, 20 };
+        bool is_reverse() const { return false; }
+    } idx;
+    struct {
+        uint64_t sp = 1, ep = 4, len = 5;
+    } factor_itr;
+    ASSERT_EQ(factor_select_first::pick_offset(idx, factor_itr, false, 0, 45), 10U);
+    ASSERT_EQ(factor_select_last::pick_offset(idx, factor_itr, false, 0, 45), 30U);
+    ASSERT_EQ(factor_select_nearest<>::pick_offset(idx, factor_itr, false, 0, 45), 50U);
+    ASSERT_EQ(factor_select_nearest<>::pick_offset(idx, factor_itr, false, 0, 75), 70U);
+    ASSERT_EQ(factor_select_nearest<>::pick_offset(idx, factor_itr, true, 1000, 75), 1070U);
+    ASSERT_EQ(factor_select_nearest<2>::pick_offset(idx, factor_itr, false, 0, 75), 50U);
+    ASSERT_EQ(factor_select_nearest<>::pick_offset(idx, factor_itr, false, 0, no_previous_factor), 10U);
+}
+
+TEST(match_length, all_lengths_and_mismatch_positions)
+{
+    // covers the 32 and 16 byte SIMD steps, the 8 byte step and the byte tail
+    std::vector<uint8_t> a(100);
+    for (size_t i = 0; i < a.size(); i++)
+        a[i] = i * 7 + 3;
+    for (size_t max_len = 0; max_len <= 100; max_len++) {
+        // exact copies of max_len bytes so reading past max_len would be detected by sanitizers
+        std::vector<uint8_t> x(a.begin(), a.begin() + max_len);
+        std::vector<uint8_t> y(x);
+        ASSERT_EQ(match_length(x.data(), y.data(), max_len), max_len);
+        ASSERT_EQ(match_length(x.begin(), y.begin(), max_len), max_len);
+        for (size_t mismatch = 0; mismatch < max_len; mismatch++) {
+            y[mismatch] ^= 0x80;
+            ASSERT_EQ(match_length(x.data(), y.data(), max_len), mismatch);
+            ASSERT_EQ(match_length(y.data(), x.data(), max_len), mismatch);
+            ASSERT_EQ(match_length(x.begin(), y.begin(), max_len), mismatch);
+            y[mismatch] ^= 0x80;
+        }
+    }
+}
+
+TEST(local_block_context, longest_earlier_repeat)
+{
+    std::mt19937 gen(4711);
+    local_block_context<1024> ctx(64);
+    for (size_t b = 0; b < 3; b++) { // blocks of different lengths reuse the context
+        size_t block_len = 2000 + 1000 * b;
+        std::vector<uint8_t> block;
+        while (block.size() < block_len) { // random text with copies of earlier parts
+            if (block.size() > 100 && gen() % 2) {
+                size_t start = gen() % (block.size() - 50);
+                for (size_t j = 0; j < 50 && block.size() < block_len; j++)
+                    block.push_back(block[start + j]);
+            }
+            else {
+                block.push_back('a' + gen() % 4);
+            }
+        }
+        ctx.reset(block_len);
+        for (size_t pos = 0; pos < block_len; pos += 1 + gen() % 20) {
+            ctx.advance(block.cbegin(), pos, block_len);
+            size_t max_len = 0;
+            for (size_t p = 0; p < pos; p++) {
+                size_t l = 0;
+                while (p + l < pos && pos + l < block_len && block[p + l] == block[pos + l])
+                    l++;
+                max_len = std::max(max_len, l);
+            }
+            auto local = ctx.find(block.cbegin(), pos, block_len);
+            if (max_len < 8) {
+                ASSERT_EQ(local.second, 0ULL);
+                continue;
+            }
+            ASSERT_EQ(local.second, max_len);
+            ASSERT_LE(local.first + local.second, pos);
+            for (size_t j = 0; j < local.second; j++)
+                ASSERT_EQ(block[local.first + j], block[pos + j]);
+        }
+    }
+}
 
 int main(int argc, char* argv[])
 {